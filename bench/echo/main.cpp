@@ -0,0 +1,117 @@
+// Ping-pong echo benchmark comparing poller backends.
+//
+// usage: bench_echo <epoll|uring> [port] [conns] [seconds] [msg_size]
+//
+// The server runs on the main thread with the selected backend; clients run
+// on a separate epoll loop and keep exactly one message in flight each.
+// With epoll the server issues one read() and one send() per message; with
+// io_uring its receives and sends are multishot/sendmsg operations submitted
+// along with each wait. That saves syscalls, but received bytes are copied
+// out of the loop's provided buffers and every send into the send buffer,
+// which large messages pay for.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shnet/event_loop.h"
+#include "shnet/tcp_client.h"
+#include "shnet/tcp_conn.h"
+#include "shnet/tcp_server.h"
+
+using shnet::EventLoop;
+using shnet::PollerBackend;
+using shnet::TcpClient;
+using shnet::TcpConn;
+using shnet::TcpServer;
+
+namespace {
+
+std::atomic<uint64_t> g_round_trips{0};
+size_t g_msg_size = 64;
+std::string g_payload;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " <epoll|uring> [port] [conns] [seconds] [msg_size]\n";
+        return 1;
+    }
+
+    SHLOG_INIT(shlog::LogLevel::WARN);
+
+    const PollerBackend backend =
+        std::strcmp(argv[1], "uring") == 0 ? PollerBackend::IoUring : PollerBackend::Epoll;
+    const uint16_t port = argc > 2 ? atoi(argv[2]) : 9100;
+    const int conns = argc > 3 ? atoi(argv[3]) : 64;
+    const int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    g_msg_size = argc > 5 ? atoi(argv[5]) : 64;
+    g_payload.assign(g_msg_size, 'x');
+
+    EventLoop server_loop(backend);
+    TcpServer server(&server_loop);
+    server.start(port, [](std::shared_ptr<TcpConn> conn) {
+        conn->setReadCallback([](std::shared_ptr<TcpConn> conn) {
+            auto msg = conn->readAll();
+            conn->send(msg.data_, msg.size_);
+            return 0;
+        });
+    });
+
+    EventLoop* client_loop = nullptr;
+    std::atomic<bool> clients_ready{false};
+    std::thread client_thread([&] {
+        EventLoop loop;
+        std::vector<std::shared_ptr<TcpClient>> clients;
+        for (int i = 0; i < conns; ++i) {
+            auto client = std::make_shared<TcpClient>(&loop);
+            client->setReadCallback([](std::shared_ptr<TcpClient> client) {
+                if (client->getReadableSize() < g_msg_size) {
+                    return -1;
+                }
+                client->readn(g_msg_size);
+                g_round_trips.fetch_add(1, std::memory_order_relaxed);
+                client->send(g_payload.data(), g_payload.size());
+                return 0;
+            });
+            if (client->connectBlocking("127.0.0.1", port) < 0) {
+                std::cerr << "connect failed\n";
+                std::exit(1);
+            }
+            clients.push_back(std::move(client));
+        }
+        client_loop = &loop;
+        clients_ready = true;
+        for (auto& client : clients) {
+            client->send(g_payload.data(), g_payload.size());
+        }
+        loop.run();
+    });
+
+    std::thread timer_thread([&] {
+        while (!clients_ready) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        const uint64_t start = g_round_trips.load();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        const uint64_t total = g_round_trips.load() - start;
+        std::cout << (backend == server_loop.backend() ? argv[1] : "epoll (fallback)")
+                  << " conns=" << conns << " msg=" << g_msg_size << "B: " << total / seconds
+                  << " round trips/s\n";
+        client_loop->stop();
+        server_loop.stop();
+    });
+
+    server_loop.run();
+    timer_thread.join();
+    client_thread.join();
+    return 0;
+}
@@ -5,23 +5,30 @@
 #include "shnet/tcp_conn.h"
 #include "shnet/tcp_server.h"
 
+using shnet::CloseReason;
 using shnet::EventLoop;
 using shnet::TcpConn;
 using shnet::TcpServer;
-using shnet::Timer;
-
-shcoro::Async<void> coroRead(std::shared_ptr<TcpConn> conn) {
-    auto msg = conn->readn(15);
-    std::string cached_data(msg.data_);
-    for (int i = 0; i < 10; i++) {
-        SHLOG_INFO("fifo await");
-        co_await shcoro::FIFOAwaiter{};
+
+// One coroutine per connection; each co_await resumes straight from the
+// connection's read handler.
+shcoro::Async<void> session(std::shared_ptr<TcpConn> conn) {
+    while (true) {
+        auto msg = co_await conn->readnAsync(15);
+        if (msg.data_ == nullptr) {
+            co_return;  // connection closed
+        }
+        std::string cached_data(msg.data_, msg.size_);
+        for (int i = 0; i < 10; i++) {
+            SHLOG_INFO("fifo await");
+            co_await shcoro::FIFOAwaiter{};
+        }
+        SHLOG_INFO("sleep 5");
+        co_await conn->getEventLoop()->sleepFor(5000);
+        SHLOG_INFO("wake up");
+        SHLOG_INFO("received: {}", cached_data);
+        conn->send("HTTP/1.1 200 OK\nContent-Length: 12\n\nHello World!\n", 50);
     }
-    SHLOG_INFO("sleep 5");
-    co_await shcoro::TimedAwaiter{&Timer::GetInst(), 5};
-    SHLOG_INFO("wake up");
-    SHLOG_INFO("received: {}", cached_data);
-    conn->send("HTTP/1.1 200 OK\nContent-Length: 12\n\nHello World!\n", 50);
 }
 
 int main(int argc, char* argv[]) {
@@ -39,15 +46,11 @@ int main(int argc, char* argv[]) {
     server.start(port, [](std::shared_ptr<TcpConn> conn) {
         SHLOG_INFO("new connection restablished");
 
-        conn->setCloseCallback([](int fd) {
-            SHLOG_INFO("connection fd {} closed", fd);
+        conn->setCloseCallback([](int fd, CloseReason reason) {
+            SHLOG_INFO("connection fd {} closed: {}", fd, toString(reason));
         });
 
-        conn->setReadCallback([](std::shared_ptr<TcpConn> conn) {
-            if (conn->getReadableSize() < 15) return -1;
-            shcoro::spawn_async_detached(coroRead(conn), conn->getEventLoop()->getScheduler());
-            return 0;
-        });
+        shcoro::spawn_async_detached(session(conn), conn->getEventLoop()->getScheduler());
     });
 
     evloop.run();
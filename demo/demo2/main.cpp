@@ -5,13 +5,13 @@
 #include "shnet/tcp_conn.h"
 #include "shnet/tcp_server.h"
 
+using shnet::CloseReason;
 using shnet::EventLoop;
 using shnet::TcpConn;
 using shnet::TcpServer;
-using shnet::Timer;
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
+    if (argc < 2) {
         return 1;
     }
 
@@ -21,12 +21,15 @@ int main(int argc, char* argv[]) {
 
     EventLoop evloop;
     TcpServer server(&evloop);
+    if (argc > 2) {
+        server.setThreadNum(atoi(argv[2]));
+    }
 
     server.start(port, [](std::shared_ptr<TcpConn> conn) {
         SHLOG_INFO("new connection restablished");
 
-        conn->setCloseCallback([](int fd) {
-            SHLOG_INFO("connection fd {} closed", fd);
+        conn->setCloseCallback([](int fd, CloseReason reason) {
+            SHLOG_INFO("connection fd {} closed: {}", fd, toString(reason));
         });
 
         conn->setReadCallback([](std::shared_ptr<TcpConn> conn) {
@@ -49,10 +52,33 @@ int main(int argc, char* argv[]) {
                 return 0;
             }
 
+            // "SUB <filter>" / "UNSUB <filter>", e.g. "SUB prices/+/btc"
+            std::string_view view(cmd);
+            if (view.starts_with("SUB ")) {
+                conn->subscribe(view.substr(4));
+                return 0;
+            }
+            if (view.starts_with("UNSUB ")) {
+                conn->unsubscribe(view.substr(6));
+                return 0;
+            }
+
+            // "PUBTO <topic> <payload>"
+            if (view.starts_with("PUBTO ")) {
+                view.remove_prefix(6);
+                auto space = view.find(' ');
+                if (space != std::string_view::npos) {
+                    std::string payload(view.substr(space + 1));
+                    payload += "\r\n";
+                    conn->broadcast(view.substr(0, space), payload.data(), payload.size());
+                }
+                return 0;
+            }
+
             cmd += "\r\n";
             constexpr std::string_view pub_prefix = "PUB ";
             if (cmd.substr(0, pub_prefix.size()) == pub_prefix) {
-                std::string_view payload = cmd.substr(pub_prefix.size());
+                std::string_view payload = std::string_view(cmd).substr(pub_prefix.size());
                 conn->broadcast(payload.data(), payload.size());
                 return 0;
             }
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+
+namespace shnet {
+
+// Why a connection was closed, as reported to close callbacks.
+enum class CloseReason : uint8_t {
+    Local,         // closed by this side (destructor, explicit close)
+    PeerClosed,    // orderly shutdown or reset by the peer
+    Error,         // socket error
+    IdleTimeout,   // no reads or writes within the idle timeout
+    ReadTimeout,   // buffered input not consumed within the read timeout
+    WriteTimeout,  // send buffer not drained within the write timeout
+};
+
+// Reason for a close caused by a failed socket call.
+inline CloseReason closeReasonFor(int err) {
+    return err == ECONNRESET || err == EPIPE ? CloseReason::PeerClosed : CloseReason::Error;
+}
+
+inline const char* toString(CloseReason reason) {
+    switch (reason) {
+        case CloseReason::Local:
+            return "local";
+        case CloseReason::PeerClosed:
+            return "peer closed";
+        case CloseReason::Error:
+            return "error";
+        case CloseReason::IdleTimeout:
+            return "idle timeout";
+        case CloseReason::ReadTimeout:
+            return "read timeout";
+        case CloseReason::WriteTimeout:
+            return "write timeout";
+    }
+    return "unknown";
+}
+
+}  // namespace shnet
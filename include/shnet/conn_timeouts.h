@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "close_reason.h"
+#include "event_loop.h"
+
+namespace shnet {
+
+// Idle, read and write deadlines of one connection, driven by a single timer
+// on the owner's loop.
+//
+// Progress only stamps the loop's cached clock; the timer is armed for the
+// earliest deadline and, when it fires, re-checks the real deadlines and
+// either expires the connection or re-arms itself. A busy connection
+// therefore costs no timer work per read or write, and an idle one costs one
+// wheel operation per timeout period.
+//
+// - idle:  no read or write progress for the timeout.
+// - read:  received data sat in the receive buffer (e.g. an incomplete
+//          message trickled in by a slow client) for the timeout.
+// - write: the send buffer stayed non-empty for the timeout.
+//
+// Loop thread only. A timeout of 0 disables that deadline.
+class ConnTimeouts {
+   public:
+    using ExpireCallback = void (*)(void* obj, CloseReason reason);
+
+    ConnTimeouts(EventLoop* loop, void* obj, ExpireCallback cb)
+        : loop_(loop), obj_(obj), expire_cb_(cb) {}
+    ~ConnTimeouts() { stop(); }
+
+    ConnTimeouts(const ConnTimeouts&) = delete;
+    ConnTimeouts& operator=(const ConnTimeouts&) = delete;
+
+    void setIdleTimeout(uint64_t ms);
+    void setReadTimeout(uint64_t ms);
+    void setWriteTimeout(uint64_t ms);
+
+    void onActivity() { last_active_ms_ = loop_->now(); }
+    void setReadPending(bool pending);
+    void setWritePending(bool pending);
+
+    void stop();
+
+   private:
+    static void timerTrampoline(void* obj);
+
+    bool enabled() const { return idle_ms_ | read_ms_ | write_ms_; }
+    // Earliest active deadline, 0 when none.
+    uint64_t nextDeadline() const;
+    void schedule(uint64_t due_ms);
+    void handleTimer();
+
+    EventLoop* loop_;
+    void* obj_;
+    ExpireCallback expire_cb_;
+    uint64_t idle_ms_{0};
+    uint64_t read_ms_{0};
+    uint64_t write_ms_{0};
+    uint64_t last_active_ms_{0};
+    uint64_t read_pending_since_{0};   // 0: receive buffer empty
+    uint64_t write_pending_since_{0};  // 0: send buffer empty
+    uint64_t timer_due_ms_{0};         // 0: timer not armed
+    EventLoop::TimerId timer_id_{};
+};
+
+}  // namespace shnet
@@ -2,17 +2,30 @@
 
 #include <sys/epoll.h>
 
+#include <array>
+#include <atomic>
+#include <coroutine>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include "shlog/logger.h"
 #include "shcoro/stackless/fifo_scheduler.hpp"
 #include "shcoro/stackless/utility.hpp"
-#include "shnet/utils/timer.h"
+#include "shnet/poller.h"
+#include "shnet/timer_wheel.h"
+#include "shnet/utils/chain_buffer.h"
+#include "shnet/utils/message_buff.h"
+#include "shnet/utils/mpsc_queue.h"
 
 namespace shnet {
 
 class TcpSocket;
 
+// An EventLoop must be run on the thread that constructed it. Every loop owns
+// its own poller and event array, so several loops may run in one process
+// (see EventLoopThreadPool).
 class EventLoop {
    public:
     struct EventHandler {
@@ -24,26 +37,159 @@ class EventLoop {
         Callback cb;
     };
 
-    EventLoop();
+    using Completion = Poller::Completion;
+    using CompletionHandler = Poller::CompletionHandler;
+    using Functor = std::function<void()>;
+    using TimerId = TimerWheel::TimerId;
+    using TimerCallback = TimerWheel::Callback;
+
+    // co_await loop->sleepFor(ms) resumes the coroutine from this loop's
+    // timer wheel.
+    struct SleepAwaiter {
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            loop->runAfter(delay_ms, &resumeTrampoline, h.address());
+        }
+        void await_resume() const noexcept {}
+
+        static void resumeTrampoline(void* addr) {
+            std::coroutine_handle<>::from_address(addr).resume();
+        }
+
+        EventLoop* loop;
+        uint64_t delay_ms;
+    };
+
+    explicit EventLoop(PollerBackend backend = PollerBackend::Epoll);
     ~EventLoop();
 
+    // Registration. With the io_uring backend these must be called on the
+    // loop thread, or while the loop isn't running; epoll allows any thread.
     int addEvent(int fd, uint32_t events, void* ptr);
 
     int modEvent(int fd, uint32_t events, void* ptr);
 
     int delEvent(int fd);
 
+    // Loop thread only: sets the interest mask of a registered fd. Changes
+    // are applied right before the next poll and only if the mask then
+    // differs from the registered one, so arming and disarming EPOLLOUT
+    // around sends costs at most one epoll_ctl() per fd and round. fds
+    // registered from another thread are modified right away.
+    void updateEvent(int fd, uint32_t events, void* ptr);
+
+    // Asynchronous accept, receive and send, where the backend runs I/O
+    // itself (io_uring with a 5.19+ kernel); see Poller for the contract.
+    // Handlers run on this loop after the readiness handlers of the round,
+    // and the operations are submitted with the next wait. Same threading
+    // rules as the io_uring registrations.
+    bool asyncIo() const { return poller_->asyncIo(); }
+    int acceptMultishot(int fd, CompletionHandler handler);
+    int recvMultishot(int fd, CompletionHandler handler);
+    int sendMsg(int fd, const msghdr* msg, CompletionHandler handler);
+    void cancelOp(int op);
+    void detachOp(int op);
+    void waitOp(int op);
+
     void run();
 
+    // Thread-safe.
     void stop();
 
+    // Runs cb right away when called on the loop thread, otherwise behaves
+    // like queueInLoop().
+    void runInLoop(Functor cb);
+
+    // Queues cb to run on the loop thread after the current round of I/O
+    // events. Thread-safe and lock-free; wakes the loop up when called from
+    // another thread, with at most one eventfd write per drained batch.
+    void queueInLoop(Functor cb);
+
+    // Runs cb after the I/O events of the current round, and the poller
+    // doesn't wait before the next one. Callbacks deferred while deferred
+    // callbacks run go to the round after, so re-deferring work yields to the
+    // other ready connections instead of starving them. Loop thread only.
+    void defer(Functor cb) { deferred_.push_back(std::move(cb)); }
+
+    bool isInLoopThread() const { return thread_id_ == std::this_thread::get_id(); }
+
+    // Timers, loop thread only. Callbacks run on this loop after the I/O
+    // events of the round; the poller wait ends at the next deadline.
+    TimerId runAfter(uint64_t delay_ms, TimerCallback cb, void* obj);
+    bool cancelTimer(TimerId id) { return timers_.cancel(id); }
+    SleepAwaiter sleepFor(uint64_t delay_ms) { return SleepAwaiter{this, delay_ms}; }
+
+    // Monotonic milliseconds, refreshed once per loop round.
+    uint64_t now() const { return now_ms_; }
+
+    // The backend actually in use (io_uring falls back to epoll).
+    PollerBackend backend() const { return poller_->backend(); }
+
     shcoro::FIFOScheduler& getScheduler() { return coro_scheduler_; }
 
+    // Buffer storage shared by the connections of this loop: blocks for send
+    // buffers, whole buffers for receive buffers.
+    BlockPool& blockPool() { return block_pool_; }
+    MessageBufferPool& messageBufferPool() { return message_buffer_pool_; }
+
+    // Where a socket read continues once the connection's receive buffer is
+    // full, so one readv() takes up to READ_SCRATCH_SIZE bytes more than the
+    // buffer has room for. The caller appends them to its buffer right away;
+    // the contents don't survive the handler.
+    char* readScratch() { return read_scratch_.get(); }
+    static constexpr size_t READ_SCRATCH_SIZE = 64 * 1024;
+
    private:
-    static const int MAX_EVENTS = 1 << 10;
+    static void wakeupTrampoline(void*, uint32_t);
+
+    void wakeup();
+    void handleWakeup();
+    void doPendingFunctors();
+    void runDeferred();
+    void flushEventUpdates();
+
+    bool pollerAccessible() const {
+        return isInLoopThread() || !running_ || backend() == PollerBackend::Epoll;
+    }
+
+    int pollTimeout() const;
+    static uint64_t clockMs();
+
+    // Interest of an fd registered from the loop thread, see updateEvent().
+    struct Interest {
+        void* ptr{nullptr};
+        uint32_t events{0};  // as registered with the poller
+        uint32_t wanted{0};
+        bool tracked{false};
+        bool queued{false};  // listed in updated_fds_
+    };
 
-    int epfd_;
-    bool running_;
+    static const int MAX_EVENTS = 1 << 10;
+    // shcoro schedulers can't be asked for pending work, so FIFO-yielded
+    // coroutines are still resumed at least this often.
+    static const int MAX_POLL_TIMEOUT_MS = 100;
+
+    std::unique_ptr<Poller> poller_;
+    int wakeup_fd_;
+    std::atomic<bool> running_;
+    // Set once a wakeup is in flight, cleared by the loop before it drains.
+    std::atomic<bool> wakeup_pending_{false};
+    bool calling_pending_{false};
+    const std::thread::id thread_id_;
+    EventHandler wakeup_handler_;
+    std::array<epoll_event, MAX_EVENTS> events_;
+    uint64_t now_ms_;
+    TimerWheel timers_;
+    std::vector<Interest> interests_;  // indexed by fd
+    std::vector<int> updated_fds_;
+    BlockPool block_pool_;
+    MessageBufferPool message_buffer_pool_;
+    std::unique_ptr<char[]> read_scratch_;
+    // After the pools: queued and deferred callbacks may own connections,
+    // which hand their buffers back when destroyed.
+    MpscQueue<Functor> pending_functors_;
+    std::vector<Functor> deferred_;
+    std::vector<Functor> running_deferred_;
     shcoro::FIFOScheduler coro_scheduler_; 
 };
-}  // namespace shnet
\ No newline at end of file
+}  // namespace shnet
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "event_loop.h"
+#include "shnet/utils/noncopyable.h"
+
+namespace shnet {
+
+// A fixed set of EventLoops, each constructed and run on its own thread.
+//
+// The base loop is the caller's loop (usually the one owning the listen
+// socket); pool loops use the same poller backend. With zero threads every
+// getter falls back to the base loop, so a pool can always be used in place
+// of a single loop.
+class EventLoopThreadPool : noncopyable {
+   public:
+    EventLoopThreadPool(EventLoop* base_loop, size_t num_threads);
+    ~EventLoopThreadPool();
+
+    // Pin loop thread i to CPU i (modulo the CPU count). Must be called before
+    // start().
+    void setCpuAffinity(bool enable) { cpu_affinity_ = enable; }
+
+    // Spawns the threads and blocks until every loop is constructed.
+    void start();
+
+    // Stops every loop and joins the threads. The loops themselves stay alive
+    // until the pool is destroyed, so objects bound to them can still be torn
+    // down safely from the caller thread.
+    void stop();
+
+    // Round-robin selection.
+    EventLoop* getNextLoop();
+
+    // Stable selection, e.g. by fd.
+    EventLoop* getLoopForHash(size_t hash);
+
+    const std::vector<EventLoop*>& getAllLoops() const { return loops_; }
+    size_t size() const { return loops_.size(); }
+    bool started() const { return started_; }
+
+   private:
+    EventLoop* base_loop_;
+    size_t num_threads_;
+    size_t next_{0};
+    bool started_{false};
+    bool cpu_affinity_{false};
+    std::vector<std::unique_ptr<EventLoop>> owned_loops_;
+    std::vector<EventLoop*> loops_;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace shnet
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "shnet/utils/message_buff.h"
+
+namespace shnet {
+
+enum class ByteOrder : uint8_t { Big, Little };
+
+enum class LengthPrefix : uint8_t {
+    Fixed,   // HeaderWidth bytes in ByteOrder
+    Varint,  // unsigned LEB128, as in protobuf
+};
+
+// Length-prefixed framing, fully configured at compile time:
+//
+//     using Codec = FrameCodec<LengthPrefix::Fixed, 4, ByteOrder::Big, 1 << 20>;
+//     conn->setFrameCallback<Codec>([](std::shared_ptr<TcpConn> conn, Message frame) {...});
+//     conn->sendFrame<Codec>(data, size);
+//
+// The length counts the payload only. decode() works in place on the receive
+// buffer: a complete frame is handed out as a view of its payload, and once
+// the header of an incomplete frame is known the buffer is grown to hold
+// the whole frame, so the rest is read straight behind it. A frame therefore
+// costs no allocation and no parsing beyond its header.
+template <LengthPrefix Prefix = LengthPrefix::Fixed, size_t HeaderWidth = 4,
+          ByteOrder Order = ByteOrder::Big, size_t MaxFrameSize = 16 * 1024 * 1024>
+class FrameCodec {
+    static_assert(Prefix == LengthPrefix::Varint || (HeaderWidth >= 1 && HeaderWidth <= 8),
+                  "fixed headers are 1 to 8 bytes wide");
+    static_assert(Prefix == LengthPrefix::Varint || HeaderWidth == 8 ||
+                      MaxFrameSize < (uint64_t{1} << (8 * HeaderWidth)),
+                  "MaxFrameSize doesn't fit in the header");
+
+    static constexpr size_t varintSize(uint64_t value) {
+        size_t n = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+   public:
+    static constexpr size_t MAX_FRAME_SIZE = MaxFrameSize;
+    static constexpr size_t MAX_HEADER_SIZE =
+        Prefix == LengthPrefix::Fixed ? HeaderWidth : varintSize(MaxFrameSize);
+
+    // Parses a header at the front of data. Returns its size and sets length,
+    // 0 when more bytes are needed, or -EMSGSIZE when the frame would exceed
+    // MAX_FRAME_SIZE.
+    static int decodeHeader(const char* data, size_t size, size_t& length) {
+        const auto* p = reinterpret_cast<const uint8_t*>(data);
+        if constexpr (Prefix == LengthPrefix::Fixed) {
+            if (size < HeaderWidth) {
+                return 0;
+            }
+            uint64_t value = 0;
+            for (size_t i = 0; i < HeaderWidth; ++i) {
+                const size_t shift = Order == ByteOrder::Big ? 8 * (HeaderWidth - 1 - i) : 8 * i;
+                value |= uint64_t{p[i]} << shift;
+            }
+            if (value > MaxFrameSize) [[unlikely]] {
+                return -EMSGSIZE;
+            }
+            length = static_cast<size_t>(value);
+            return static_cast<int>(HeaderWidth);
+        } else {
+            uint64_t value = 0;
+            const size_t avail = size < MAX_HEADER_SIZE ? size : MAX_HEADER_SIZE;
+            for (size_t i = 0; i < avail; ++i) {
+                value |= uint64_t{p[i] & 0x7fu} << (7 * i);
+                if ((p[i] & 0x80) == 0) {
+                    if (value > MaxFrameSize) [[unlikely]] {
+                        return -EMSGSIZE;
+                    }
+                    length = static_cast<size_t>(value);
+                    return static_cast<int>(i + 1);
+                }
+            }
+            // A longer header could only encode a larger length.
+            return size < MAX_HEADER_SIZE ? 0 : -EMSGSIZE;
+        }
+    }
+
+    // Writes the header for a payload of length bytes to out, which has room
+    // for MAX_HEADER_SIZE bytes. Returns its size, or 0 when length exceeds
+    // MAX_FRAME_SIZE.
+    static size_t encodeHeader(size_t length, char* out) {
+        if (length > MaxFrameSize) [[unlikely]] {
+            return 0;
+        }
+        auto* p = reinterpret_cast<uint8_t*>(out);
+        uint64_t value = length;
+        if constexpr (Prefix == LengthPrefix::Fixed) {
+            for (size_t i = 0; i < HeaderWidth; ++i) {
+                const size_t shift = Order == ByteOrder::Big ? 8 * (HeaderWidth - 1 - i) : 8 * i;
+                p[i] = static_cast<uint8_t>(value >> shift);
+            }
+            return HeaderWidth;
+        } else {
+            size_t n = 0;
+            while (value >= 0x80) {
+                p[n++] = static_cast<uint8_t>(value | 0x80);
+                value >>= 7;
+            }
+            p[n++] = static_cast<uint8_t>(value);
+            return n;
+        }
+    }
+
+    // Takes the next complete frame out of buf. Returns 1 with frame set to
+    // its payload (valid until buf is written to again), 0 when the frame is
+    // incomplete, or -EMSGSIZE for an oversized frame.
+    static int decode(MessageBuffer& buf, Message& frame) {
+        const size_t readable = buf.readableSize();
+        if (readable == 0) {
+            return 0;
+        }
+        size_t length = 0;
+        const int header = decodeHeader(buf.readPointer(), readable, length);
+        if (header <= 0) {
+            return header;
+        }
+        const size_t total = static_cast<size_t>(header) + length;
+        if (readable < total) {
+            // Room for the rest of the frame, so it is read in one piece.
+            buf.prepare(total - readable);
+            return 0;
+        }
+        frame = {buf.readPointer() + header, length};
+        buf.readCommit(total);
+        return 1;
+    }
+};
+
+}  // namespace shnet
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <memory>
+
+#include "shnet/utils/noncopyable.h"
+
+namespace shnet {
+
+enum class PollerBackend {
+    Epoll,
+    IoUring,
+};
+
+// Readiness notification backend of an EventLoop.
+//
+// Interest masks and reported events use the EPOLL* bit values regardless of
+// the backend, and ptr is handed back untouched in epoll_event::data.ptr.
+//
+// Backends that run I/O themselves (io_uring) also offer asynchronous
+// operations: the kernel accepts, receives or sends on its own and the result
+// is handed to a CompletionHandler from dispatchCompletions(). Multishot
+// operations stay armed and complete many times, until a completion without
+// `more`; the handler must stay valid until then, or until detachOp().
+//
+// Not thread-safe: once the owning loop runs, every call must come from its
+// thread. The io_uring backend keeps its registrations and the SQ ring in
+// plain memory; EventLoop asserts this for it.
+class Poller : noncopyable {
+   public:
+    struct Completion {
+        int res;           // what the syscall would have returned, or -errno
+        bool more;         // a multishot operation stays armed
+        const char* data;  // bytes of a receive, valid during the callback
+    };
+
+    struct CompletionHandler {
+        using Callback = void (*)(void* obj, const Completion& completion);
+
+        inline void operator()(const Completion& c) const noexcept { cb(obj, c); }
+
+        void* obj;
+        Callback cb;
+    };
+
+    virtual ~Poller() = default;
+
+    // Returns 0 on success, -1 with errno set on failure.
+    virtual int addEvent(int fd, uint32_t events, void* ptr) = 0;
+    virtual int modEvent(int fd, uint32_t events, void* ptr) = 0;
+    virtual int delEvent(int fd) = 0;
+
+    // Waits up to timeout_ms (-1: forever) and fills at most max_events ready
+    // entries. Returns the number of entries, or -1 with errno set.
+    virtual int poll(epoll_event* events, int max_events, int timeout_ms) = 0;
+
+    virtual PollerBackend backend() const = 0;
+
+    // Asynchronous operations. Each returns an operation id, or -1 with errno
+    // set; ENOTSUP where asyncIo() is false.
+    virtual bool asyncIo() const { return false; }
+    // Accepts connections on a listen fd until cancelled. res is the new fd,
+    // non-blocking and close-on-exec.
+    virtual int acceptMultishot(int, CompletionHandler) { return unsupported(); }
+    // Receives into buffers of the poller until the peer closes (res 0) or
+    // the buffers run out (-ENOBUFS); data holds res bytes.
+    virtual int recvMultishot(int, CompletionHandler) { return unsupported(); }
+    // One sendmsg() with MSG_NOSIGNAL; msg and the bytes it points to must
+    // stay valid until the completion.
+    virtual int sendMsg(int, const msghdr*, CompletionHandler) { return unsupported(); }
+    // Stops an operation early. cancelOp() still hands the last completion
+    // to the handler; after detachOp() it is never called again, which only
+    // suits operations that don't point into memory of the caller.
+    virtual void cancelOp(int) {}
+    virtual void detachOp(int) {}
+    // Blocks until the last completion of a single-shot operation was handed
+    // to its handler, which happens right from this call.
+    virtual void waitOp(int) {}
+    // Runs the handlers of the operations poll() found completed.
+    virtual void dispatchCompletions() {}
+    // Cancels the single-shot operations in flight and waits for their
+    // handlers to run; for a loop that stops. Multishot ones stay armed.
+    virtual void drainOps() {}
+
+    // Falls back to epoll when the requested backend is unavailable.
+    static std::unique_ptr<Poller> create(PollerBackend backend);
+
+   private:
+    static int unsupported() {
+        errno = ENOTSUP;
+        return -1;
+    }
+};
+
+}  // namespace shnet
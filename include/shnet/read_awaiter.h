@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <coroutine>
+#include <string_view>
+
+#include "shlog/logger.h"
+#include "shnet/utils/message_buff.h"
+
+namespace shnet {
+
+// Awaiter returned by the read*Async() helpers of TcpConn and TcpClient.
+//
+// co_await completes right away when the receive buffer already holds what
+// was asked for. Otherwise the coroutine registers itself as the connection's
+// single pending reader and is resumed straight from handleRead() once enough
+// bytes arrived, ahead of the read callback. The returned Message is consumed
+// from the receive buffer and stays valid until the coroutine suspends again,
+// since a drained buffer goes back to the loop's pool; a null Message means
+// the connection closed (or another reader was pending).
+class ReadAwaiter {
+   public:
+    enum class Mode : uint8_t { Exactly, Until, UntilCRLF, UntilDelimiter, Some };
+
+    // buf is null for a closed connection; slot is the connection's pending
+    // reader. The bytes of delimiter must outlive the co_await.
+    ReadAwaiter(MessageBuffer* buf, ReadAwaiter** slot, Mode mode, size_t n = 0,
+                char terminator = 0, std::string_view delimiter = {})
+        : buf_(buf),
+          slot_(slot),
+          n_(n),
+          mode_(mode),
+          terminator_(terminator),
+          delimiter_(delimiter) {}
+
+    bool await_ready() {
+        if (buf_ == nullptr) [[unlikely]] {
+            return true;
+        }
+        if (*slot_ != nullptr) [[unlikely]] {
+            SHLOG_ERROR("concurrent read awaiters on one connection");
+            return true;
+        }
+        return tryRead();
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        handle_ = h;
+        *slot_ = this;
+    }
+
+    Message await_resume() const noexcept { return result_; }
+
+    // Connection side: takes the result out of the buffer when it is there.
+    bool tryRead() {
+        Message msg{nullptr, 0};
+        size_t consumed = 0;
+        switch (mode_) {
+            case Mode::Exactly:
+                msg = buf_->getData(n_);
+                consumed = msg.size_;
+                if (msg.data_ == nullptr && buf_->getBufferSize() < n_) {
+                    // Make room for the whole message up front.
+                    buf_->prepare(n_ - buf_->readableSize());
+                }
+                break;
+            case Mode::Until:
+                msg = buf_->getDataUntil(terminator_);
+                consumed = msg.size_ + 1;
+                break;
+            case Mode::UntilCRLF:
+                msg = buf_->getDataUntilCRLF();
+                consumed = msg.size_ + 2;
+                break;
+            case Mode::UntilDelimiter:
+                msg = buf_->getDataUntil(delimiter_);
+                consumed = msg.size_ + delimiter_.size();
+                break;
+            case Mode::Some:
+                msg = buf_->getAllData();
+                consumed = msg.size_;
+                if (msg.size_ == 0) {
+                    msg.data_ = nullptr;
+                }
+                break;
+        }
+        if (msg.data_ == nullptr) {
+            return false;
+        }
+        buf_->readCommit(consumed);
+        result_ = msg;
+        return true;
+    }
+
+    // Connection side: resumes the suspended reader with result_, which stays
+    // null when the connection is closing.
+    void resume() {
+        *slot_ = nullptr;
+        handle_.resume();
+    }
+
+   private:
+    MessageBuffer* buf_;
+    ReadAwaiter** slot_;
+    size_t n_;
+    Mode mode_;
+    char terminator_;
+    std::string_view delimiter_;
+    Message result_{nullptr, 0};
+    std::coroutine_handle<> handle_;
+};
+
+}  // namespace shnet
@@ -2,11 +2,19 @@
 
 #include <functional>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
 
+#include "close_reason.h"
+#include "conn_timeouts.h"
 #include "event_loop.h"
+#include "frame_codec.h"
+#include "read_awaiter.h"
 #include "shcoro/stackless/async.hpp"
+#include "shnet/utils/chain_buffer.h"
 #include "shnet/utils/message_buff.h"
+#include "shnet/utils/wait_queue.h"
 #include "tcp_socket.h"
 
 namespace shnet {
@@ -17,7 +25,9 @@ namespace shnet {
 class TcpClient : public std::enable_shared_from_this<TcpClient> {
    public:
     using ReadCallback = int (*)(std::shared_ptr<TcpClient>);
-    using CloseCallback = void (*)(int);
+    using FrameCallback = void (*)(std::shared_ptr<TcpClient>, Message frame);
+    using CloseCallback = void (*)(int fd, CloseReason reason);
+    using WatermarkCallback = void (*)(std::shared_ptr<TcpClient>, size_t buffered);
     using ConnectCallback = void (*)();
 
     explicit TcpClient(EventLoop* evLoop);
@@ -47,16 +57,54 @@ class TcpClient : public std::enable_shared_from_this<TcpClient> {
     // - Returns 0 on success.
     // - Returns negative errno on failure (e.g. -ECONNREFUSED, -ETIMEDOUT).
     int connectBlocking(const std::string& ip, uint16_t port);
+
+    // Same as connect()/connectBlocking() over an AF_UNIX stream socket, for
+    // peers on the same host. A path starting with '@' is an abstract-namespace
+    // address. Everything after the connect behaves exactly as over TCP.
+    // Returns -EISCONN if a connection was already made or started.
+    int connectUnix(const std::string& path);
+    int connectUnixBlocking(const std::string& path);
     void setConnectCallback(ConnectCallback cb) { connect_cb_ = cb; }
 
+    // Register the socket edge-triggered (EPOLLIN | EPOLLOUT | EPOLLET): reads
+    // and writes drain until EAGAIN and write interest never has to be
+    // toggled. Must be called before connect().
+    void setEdgeTriggered(bool enable) { edge_triggered_ = enable; }
+
     // Read helpers (consume data from internal receive buffer).
     Message readAll();
     Message readUntil(char terminator);
     Message readUntilCRLF();
+    // Multi-byte delimiter, e.g. readUntil("\r\n\r\n") for HTTP headers.
+    Message readUntil(std::string_view delimiter);
     Message readn(size_t n);
     size_t getReadableSize() { return rcv_buf_.readableSize(); }
 
+    // Awaitable counterparts of the helpers above, e.g.
+    //     Message line = co_await conn->readUntilCRLFAsync();
+    // One pending reader per connection; see ReadAwaiter.
+    ReadAwaiter readnAsync(size_t n) { return readAwaiter(ReadAwaiter::Mode::Exactly, n); }
+    ReadAwaiter readUntilAsync(char terminator) {
+        return readAwaiter(ReadAwaiter::Mode::Until, 0, terminator);
+    }
+    ReadAwaiter readUntilCRLFAsync() { return readAwaiter(ReadAwaiter::Mode::UntilCRLF); }
+    // delimiter must stay alive until the co_await completes.
+    ReadAwaiter readUntilAsync(std::string_view delimiter) {
+        return readAwaiter(ReadAwaiter::Mode::UntilDelimiter, 0, 0, delimiter);
+    }
+    // Whatever is buffered, as soon as at least one byte is.
+    ReadAwaiter readSomeAsync() { return readAwaiter(ReadAwaiter::Mode::Some); }
+
     void setReadCallback(ReadCallback cb);
+    // Length-prefixed framing: complete frames decoded by Codec (a
+    // FrameCodec) are delivered to cb instead of calling the read callback.
+    // frame points into the receive buffer and is valid until cb returns. An
+    // oversized frame closes the connection with CloseReason::Error.
+    template <typename Codec>
+    void setFrameCallback(FrameCallback cb) {
+        frame_decoder_ = &Codec::decode;
+        frame_cb_ = cb;
+    }
 
     // Buffered, non-blocking send.
     //
@@ -68,42 +116,134 @@ class TcpClient : public std::enable_shared_from_this<TcpClient> {
     // Note: returning 0 does NOT guarantee the peer has received the data; it only
     // means this connection has taken ownership for delivery.
     int send(const char* data, size_t size);
+    // Scatter-gather variants of send(), e.g. header + body + trailer without
+    // concatenating them first. Written with one sendmsg() when nothing is
+    // buffered, otherwise appended to the send buffer piece by piece.
+    int sendv(const struct iovec* iov, int iovcnt);
+    int send(std::span<const std::span<const char>> pieces);
     int sendBlocking(const char* data, size_t size);
+    // Sends data as one Codec frame; -EMSGSIZE when it is too large.
+    template <typename Codec>
+    int sendFrame(const char* data, size_t size) {
+        char header[Codec::MAX_HEADER_SIZE];
+        const size_t header_size = Codec::encodeHeader(size, header);
+        if (header_size == 0) [[unlikely]] {
+            return -EMSGSIZE;
+        }
+        struct iovec iov[2] = {{header, header_size}, {const_cast<char*>(data), size}};
+        return sendv(iov, size > 0 ? 2 : 1);
+    }
     bool sendAsyncShouldYield(size_t size) { return snd_buf_.getFreeSize() < size; }
+    // Waits while the send buffer lacks room: the coroutine is parked and
+    // resumed from the write handler once the buffer drained to the low
+    // watermark. Data larger than the buffer is taken once it is empty.
     shcoro::Async<int> sendAsync(const char* data, size_t size);
 
+    // Send-buffer flow control. The high callback runs once the buffered
+    // bytes reach high; the low callback runs when they drain back to low
+    // afterwards, which is also when parked sendAsync() callers are resumed.
+    void setWriteWatermarks(size_t high, size_t low) {
+        high_watermark_ = high;
+        low_watermark_ = low;
+    }
+    void setHighWatermarkCallback(WatermarkCallback cb) { high_watermark_cb_ = cb; }
+    void setLowWatermarkCallback(WatermarkCallback cb) { low_watermark_cb_ = cb; }
+
     void setCloseCallback(CloseCallback cb) { close_cb_ = cb; }
 
+    // Deadlines in milliseconds, 0 (the default) disables them. Expiry closes
+    // the connection with the matching CloseReason. Loop thread only.
+    // - idle:  no bytes read or written for ms.
+    // - read:  received data stayed unconsumed by the read callback for ms,
+    //          e.g. a partial request trickled in by a slow client.
+    // - write: the send buffer did not drain within ms.
+    void setIdleTimeout(uint64_t ms) { timeouts_.setIdleTimeout(ms); }
+    void setReadTimeout(uint64_t ms) { timeouts_.setReadTimeout(ms); }
+    void setWriteTimeout(uint64_t ms) { timeouts_.setWriteTimeout(ms); }
+
     EventLoop* getEventLoop() const { return ev_loop_; }
     bool isConnected() const { return connected_; }
 
    private:
     static void ioTrampoline(void*, uint32_t);
+    static void timeoutTrampoline(void*, CloseReason);
+
+    // Replaces the not yet connected socket with an AF_UNIX one.
+    int openUnixSocket(const UnixAddress& addr);
+    int connectTo(const sockaddr* addr, socklen_t len);
+    int connectBlockingTo(const sockaddr* addr, socklen_t len);
 
     void handleIO(uint32_t);
     void handleConnect();
-    void handleRead();
+    // peer_closing: EPOLLRDHUP was reported along with the data.
+    void handleRead(bool peer_closing);
     void handleWrite();
-
-    void close();
+    void dispatchRead();
+
+    ReadAwaiter readAwaiter(ReadAwaiter::Mode mode, size_t n = 0, char terminator = 0,
+                            std::string_view delimiter = {}) {
+        resumeReading();
+        return ReadAwaiter(closed_ ? nullptr : &rcv_buf_, &read_waiter_, mode, n, terminator,
+                           delimiter);
+    }
+
+    uint32_t ioEvents(bool want_write) const;
+
+    // Reading stops while MAX_UNREAD bytes sit unconsumed in a full receive
+    // buffer, instead of waking up for data there is no room for. Any read
+    // helper resumes it; handleRead() pauses again if nothing was consumed.
+    void pauseReading();
+    void resumeReading() {
+        if (read_paused_) [[unlikely]] {
+            unpauseReading();
+        }
+    }
+    void unpauseReading();
+    void close(CloseReason reason = CloseReason::Local);
 
     void enableWrite();
     void disableWrite();
 
+    // Appends to the send buffer, arms EPOLLOUT and checks the high watermark.
+    void bufferSend(const char* data, size_t size);
+    // Same for the gathered pieces, minus the first skip bytes.
+    void bufferSendv(const struct iovec* iov, int iovcnt, size_t skip);
+    void onSendBuffered();
+    void checkLowWatermark();
+
     static constexpr size_t SOCK_RCV_LEN = MessageBuffer::DEFAULT_SIZE * 2;
     static constexpr size_t SOCK_SEND_LEN = MessageBuffer::DEFAULT_SIZE * 2;
+    // Initial receive buffer; reads beyond it go through the loop's scratch
+    // buffer and grow it.
+    static constexpr size_t RCV_BUF_SIZE = 4 * 1024;
+    // Unread bytes past which the receive buffer no longer grows on its own.
+    static constexpr size_t MAX_UNREAD = 4 * 1024 * 1024;
+    // Blocks handed to one writev() when flushing the send buffer.
+    static constexpr int MAX_FLUSH_IOV = 64;
 
     EventLoop* ev_loop_;
     EventLoop::EventHandler io_handler_;
-    MessageBuffer rcv_buf_{SOCK_RCV_LEN};
-    MessageBuffer snd_buf_{SOCK_SEND_LEN};
+    ConnTimeouts timeouts_;
+    MessageBuffer rcv_buf_;
+    ChainBuffer snd_buf_;
+    ReadAwaiter* read_waiter_{nullptr};
+    WaitQueue write_waiters_;
+    size_t high_watermark_{SOCK_SEND_LEN};
+    size_t low_watermark_{SOCK_SEND_LEN / 2};
+    WatermarkCallback high_watermark_cb_{nullptr};
+    WatermarkCallback low_watermark_cb_{nullptr};
+    bool above_high_watermark_{false};
     ReadCallback read_cb_{nullptr};
+    FrameCallback frame_cb_{nullptr};
+    int (*frame_decoder_)(MessageBuffer&, Message&){nullptr};
     CloseCallback close_cb_{nullptr};
     ConnectCallback connect_cb_{nullptr};
     TcpSocket conn_sk_;
     bool closed_{false};
     bool connect_in_progress_{false};
     bool connected_{false};
+    bool edge_triggered_{false};
+    bool read_paused_{false};
 };
 
 }  // namespace shnet
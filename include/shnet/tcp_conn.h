@@ -2,11 +2,21 @@
 
 #include <functional>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "close_reason.h"
+#include "conn_timeouts.h"
 #include "event_loop.h"
+#include "frame_codec.h"
+#include "read_awaiter.h"
 #include "shcoro/stackless/async.hpp"
+#include "shnet/utils/chain_buffer.h"
 #include "shnet/utils/message_buff.h"
+#include "shnet/utils/shared_payload.h"
+#include "shnet/utils/wait_queue.h"
 #include "tcp_socket.h"
 
 namespace shnet {
@@ -18,17 +28,54 @@ class TcpConn : public std::enable_shared_from_this<TcpConn> {
 
    public:
     using ReadCallback = int (*)(std::shared_ptr<TcpConn>);
-    using CloseCallback = void (*)(int);
+    using FrameCallback = void (*)(std::shared_ptr<TcpConn>, Message frame);
+    using CloseCallback = void (*)(int fd, CloseReason reason);
+    using WatermarkCallback = void (*)(std::shared_ptr<TcpConn>, size_t buffered);
 
-    TcpConn(int fd, EventLoop* evLoop);
+    // With edge_triggered the fd is registered once with
+    // EPOLLIN | EPOLLOUT | EPOLLET: reads and writes drain until EAGAIN and
+    // write interest never has to be toggled. unix_domain marks an AF_UNIX
+    // stream fd, for which TCP-only socket options are skipped.
+    //
+    // On a loop with asynchronous I/O (io_uring) the connection receives
+    // through a multishot receive and hands its send buffer to the kernel
+    // as one sendmsg operation at a time; edge_triggered has no effect there.
+    // Must be constructed on the loop thread.
+    TcpConn(int fd, EventLoop* evLoop, bool edge_triggered = false, bool unix_domain = false);
     ~TcpConn();
 
     Message readAll();
     Message readUntil(char terminator);
     Message readUntilCRLF();
+    // Multi-byte delimiter, e.g. readUntil("\r\n\r\n") for HTTP headers.
+    Message readUntil(std::string_view delimiter);
     Message readn(size_t n);
     size_t getReadableSize() { return rcv_buf_.readableSize(); }
+
+    // Awaitable counterparts of the helpers above, e.g.
+    //     Message line = co_await conn->readUntilCRLFAsync();
+    // One pending reader per connection; see ReadAwaiter.
+    ReadAwaiter readnAsync(size_t n) { return readAwaiter(ReadAwaiter::Mode::Exactly, n); }
+    ReadAwaiter readUntilAsync(char terminator) {
+        return readAwaiter(ReadAwaiter::Mode::Until, 0, terminator);
+    }
+    ReadAwaiter readUntilCRLFAsync() { return readAwaiter(ReadAwaiter::Mode::UntilCRLF); }
+    // delimiter must stay alive until the co_await completes.
+    ReadAwaiter readUntilAsync(std::string_view delimiter) {
+        return readAwaiter(ReadAwaiter::Mode::UntilDelimiter, 0, 0, delimiter);
+    }
+    // Whatever is buffered, as soon as at least one byte is.
+    ReadAwaiter readSomeAsync() { return readAwaiter(ReadAwaiter::Mode::Some); }
     void setReadCallback(ReadCallback cb);
+    // Length-prefixed framing: complete frames decoded by Codec (a
+    // FrameCodec) are delivered to cb instead of calling the read callback.
+    // frame points into the receive buffer and is valid until cb returns. An
+    // oversized frame closes the connection with CloseReason::Error.
+    template <typename Codec>
+    void setFrameCallback(FrameCallback cb) {
+        frame_decoder_ = &Codec::decode;
+        frame_cb_ = cb;
+    }
 
     // Buffered, non-blocking send.
     //
@@ -40,18 +87,103 @@ class TcpConn : public std::enable_shared_from_this<TcpConn> {
     // Note: returning 0 does NOT guarantee the peer has received the data; it only
     // means this connection has taken ownership for delivery.
     int send(const char* data, size_t size);
+    // Scatter-gather variants of send(), e.g. header + body + trailer without
+    // concatenating them first. Written with one sendmsg() when nothing is
+    // buffered, otherwise appended to the send buffer piece by piece.
+    int sendv(const struct iovec* iov, int iovcnt);
+    int send(std::span<const std::span<const char>> pieces);
+    // Like send(), but a part that can't be written right away is queued by
+    // reference instead of copied. A payload larger than the send buffer is
+    // taken while the buffer is empty.
+    int send(const SharedPayload::Ref& payload);
+    // Sends size bytes of the regular file fd from offset on, in order with
+    // the other sends, using sendfile() so the contents never pass through
+    // user space. fd is duplicated, so the caller may close it right away;
+    // the file must not shrink before it was sent. Queued file bytes take no
+    // send buffer capacity but count toward the write watermarks. Returns 0,
+    // -EINVAL for a range outside the file, or another negative errno.
+    int sendFile(int fd, off_t offset, size_t size);
     int sendBlocking(const char* data, size_t size);
+    // Sends data as one Codec frame; -EMSGSIZE when it is too large.
+    template <typename Codec>
+    int sendFrame(const char* data, size_t size) {
+        char header[Codec::MAX_HEADER_SIZE];
+        const size_t header_size = Codec::encodeHeader(size, header);
+        if (header_size == 0) [[unlikely]] {
+            return -EMSGSIZE;
+        }
+        struct iovec iov[2] = {{header, header_size}, {const_cast<char*>(data), size}};
+        return sendv(iov, size > 0 ? 2 : 1);
+    }
     bool sendAsyncShouldYield(size_t size) { return snd_buf_.getFreeSize() < size; }
+    // Waits while the send buffer lacks room: the coroutine is parked and
+    // resumed from the write handler once the buffer drained to the low
+    // watermark. Data larger than the buffer is taken once it is empty.
     shcoro::Async<int> sendAsync(const char* data, size_t size);
 
-    // Subscription helpers
+    // Send-buffer flow control. The high callback runs once the buffered
+    // bytes reach high; the low callback runs when they drain back to low
+    // afterwards, which is also when parked sendAsync() callers are resumed.
+    void setWriteWatermarks(size_t high, size_t low) {
+        high_watermark_ = high;
+        low_watermark_ = low;
+    }
+    void setHighWatermarkCallback(WatermarkCallback cb) { high_watermark_cb_ = cb; }
+    void setLowWatermarkCallback(WatermarkCallback cb) { low_watermark_cb_ = cb; }
+
+    // Subscription helpers. Without a filter they subscribe to the "" topic.
+    // subscribe() returns -EINVAL for a malformed filter, see TopicRegistry.
     void subscribe();
     void unsubscribe();
+    int subscribe(std::string_view filter);
+    void unsubscribe(std::string_view filter);
     // Broadcast helpers – calls owner server’s broadcast().
     int broadcast(const char* data, size_t size);
+    int broadcast(std::string_view topic, const char* data, size_t size);
 
     void setCloseCallback(CloseCallback cb) { close_cb_ = cb; }
 
+    // Zero-copy sends (SO_ZEROCOPY). From then on a SharedPayload of at least
+    // min_size bytes passed to send() is handed to the kernel by reference
+    // with MSG_ZEROCOPY instead of being copied into the socket. The
+    // connection holds a reference to the payload until the kernel reports
+    // the pages done on the socket error queue, so the release callback of a
+    // SharedPayload::wrap()ped buffer tells its owner when it may reuse it.
+    // Pinning pages and handling completions costs more than copying small
+    // writes; the kernel also copies anyway over loopback. Returns 0, or a
+    // negative errno when the socket doesn't support it.
+    int enableZeroCopy(size_t min_size = DEFAULT_ZEROCOPY_THRESHOLD);
+
+    // Send coalescing for chatty protocols: sends only append to the send
+    // buffer, which is flushed once after the I/O events of the loop round,
+    // so a handler's several small writes leave in one writev() and fewer
+    // segments. With cork, that flush is bracketed by TCP_CORK, which also
+    // packs data written by separate calls, e.g. around a sendFile(); it is
+    // ignored on AF_UNIX connections. Off by default; it adds up to one loop
+    // round of latency. On a loop with asynchronous I/O sends are always
+    // coalesced, and cork has no effect.
+    void setSendCoalescing(bool enable, bool cork = false);
+
+    // Deadlines in milliseconds, 0 (the default) disables them. Expiry closes
+    // the connection with the matching CloseReason. Loop thread only.
+    // - idle:  no bytes read or written for ms.
+    // - read:  received data stayed unconsumed by the read callback for ms,
+    //          e.g. a partial request trickled in by a slow client.
+    // - write: the send buffer did not drain within ms.
+    void setIdleTimeout(uint64_t ms) { timeouts_.setIdleTimeout(ms); }
+    void setReadTimeout(uint64_t ms) { timeouts_.setReadTimeout(ms); }
+    void setWriteTimeout(uint64_t ms) { timeouts_.setWriteTimeout(ms); }
+
+    // Bounds the work one readiness event gets: after max_messages read or
+    // frame callbacks, or once max_bytes were consumed, the remaining
+    // buffered data is dispatched in the next loop round, after the other
+    // ready connections had their turn. 0 lifts a limit. Defaults to 64
+    // messages and 256 KiB. Coroutine readers are not counted.
+    void setReadBudget(size_t max_bytes, size_t max_messages) {
+        read_budget_bytes_ = max_bytes;
+        read_budget_messages_ = max_messages;
+    }
+
     EventLoop* getEventLoop() const { return ev_loop_; }
 
    private:
@@ -65,6 +197,9 @@ class TcpConn : public std::enable_shared_from_this<TcpConn> {
     };
 
     static void ioTrampoline(void*, uint32_t);
+    static void timeoutTrampoline(void*, CloseReason);
+    static void recvTrampoline(void*, const EventLoop::Completion&);
+    static void sendTrampoline(void*, const EventLoop::Completion&);
 
     void setRemoveConnHandler(RemoveConnHandler handler) {
         remove_conn_handler_ = handler;
@@ -72,28 +207,146 @@ class TcpConn : public std::enable_shared_from_this<TcpConn> {
 
     void handleIO(uint32_t);
 
-    void handleRead();
+    // peer_closing: EPOLLRDHUP was reported along with the data.
+    void handleRead(bool peer_closing);
+    void closeAtPeerEof();
+    // Multishot receive, see asyncIo(); falls back to EPOLLIN readiness when
+    // the kernel can't do it.
+    void submitRecv();
+    void handleRecv(const EventLoop::Completion&);
     void handleWrite();
+    // Writes the send buffer until it is empty or the socket is full, or
+    // with submit hands it to a send operation. False when it closed.
+    bool flushSendBuffer(bool submit);
+    void dispatchRead();
+    bool readBudgetSpent(size_t messages, size_t consumed) const {
+        return (read_budget_messages_ != 0 && messages >= read_budget_messages_) ||
+               (read_budget_bytes_ != 0 && consumed >= read_budget_bytes_);
+    }
+    // Continues dispatchRead() in the next loop round.
+    void deferDispatch();
+
+    ReadAwaiter readAwaiter(ReadAwaiter::Mode mode, size_t n = 0, char terminator = 0,
+                            std::string_view delimiter = {}) {
+        resumeReading();
+        return ReadAwaiter(closed_ ? nullptr : &rcv_buf_, &read_waiter_, mode, n, terminator,
+                           delimiter);
+    }
+
+    // Reading stops while MAX_UNREAD bytes sit unconsumed in a full receive
+    // buffer, instead of waking up for data there is no room for. Any read
+    // helper resumes it; handleRead() pauses again if nothing was consumed.
+    void pauseReading();
+    void resumeReading() {
+        if (read_paused_) [[unlikely]] {
+            unpauseReading();
+        }
+    }
+    void unpauseReading();
+    uint32_t ioEvents(bool want_write) const;
 
-    void close();
+    void close(CloseReason reason = CloseReason::Local);
     void removeFromServer();
 
     void enableWrite();
     void disableWrite();
 
+    // Appends to the send buffer, arms EPOLLOUT and checks the high watermark.
+    void bufferSend(const char* data, size_t size);
+    // Same for the gathered pieces, minus the first skip bytes.
+    void bufferSendv(const struct iovec* iov, int iovcnt, size_t skip);
+    void onSendBuffered();
+    // 0 when size more bytes fit into the send buffer, which a shared
+    // payload only needs empty; -ENOBUFS otherwise.
+    int reserveSend(size_t size, bool shared);
+    // Writes what coalesced sends buffered during the round.
+    void flushCoalesced();
+    void checkLowWatermark();
+    // Whether a send may go to the socket right away: nothing is queued
+    // ahead of it, and sends are neither coalesced nor left to the kernel.
+    bool canSendDirectly() const { return snd_buf_.empty() && !coalesce_ && !async_send_; }
+
+    // Hands the plain bytes at the front of the send buffer to the kernel as
+    // one sendmsg operation. False when the front is a file or zero-copy
+    // segment, which flushHead() writes, or the operation can't be started.
+    bool submitSend();
+    void handleSendDone(const EventLoop::Completion&);
+    // Writes from the front of the send buffer, with sendfile() or
+    // MSG_ZEROCOPY when its first segment asks for it.
+    ssize_t flushHead(struct iovec* iov);
+    // Sends one payload range with MSG_ZEROCOPY and tracks its completion.
+    ssize_t sendZeroCopy(const struct iovec& iov, SharedPayload* payload);
+    // Drains the error queue; false when the socket has a real error.
+    bool handleErrorQueue();
+    void completeZeroCopy(uint32_t last);
+    void releaseZeroCopy();
+
+    // A zero-copy send whose pages the kernel may still read.
+    struct ZeroCopySend {
+        uint32_t seq;
+        SharedPayload* payload;
+    };
+
     static constexpr size_t SOCK_RCV_LEN = MessageBuffer::DEFAULT_SIZE * 2;
     static constexpr size_t SOCK_SEND_LEN = MessageBuffer::DEFAULT_SIZE * 2;
+    // Initial receive buffer; reads beyond it go through the loop's scratch
+    // buffer and grow it.
+    static constexpr size_t RCV_BUF_SIZE = 4 * 1024;
+    // Unread bytes past which the receive buffer no longer grows on its own.
+    static constexpr size_t MAX_UNREAD = 4 * 1024 * 1024;
+    // Blocks handed to one writev() when flushing the send buffer.
+    static constexpr int MAX_FLUSH_IOV = 64;
+    static constexpr size_t DEFAULT_ZEROCOPY_THRESHOLD = 32 * 1024;
+    static constexpr size_t DEFAULT_READ_BUDGET_BYTES = 256 * 1024;
+    static constexpr size_t DEFAULT_READ_BUDGET_MESSAGES = 64;
+
+    // Arguments of the sendmsg operation in flight.
+    struct SendMsg {
+        msghdr msg;
+        iovec iov[MAX_FLUSH_IOV];
+    };
 
     EventLoop* ev_loop_;
     EventLoop::EventHandler io_handler_;
+    ConnTimeouts timeouts_;
     MessageBuffer rcv_buf_;
-    MessageBuffer snd_buf_;
-    ReadCallback read_cb_;
-    CloseCallback close_cb_;
+    ChainBuffer snd_buf_;
+    ReadAwaiter* read_waiter_{nullptr};
+    WaitQueue write_waiters_;
+    size_t high_watermark_{MessageBuffer::DEFAULT_SIZE};
+    size_t low_watermark_{MessageBuffer::DEFAULT_SIZE / 2};
+    WatermarkCallback high_watermark_cb_{nullptr};
+    WatermarkCallback low_watermark_cb_{nullptr};
+    bool above_high_watermark_{false};
+    size_t read_budget_bytes_{DEFAULT_READ_BUDGET_BYTES};
+    size_t read_budget_messages_{DEFAULT_READ_BUDGET_MESSAGES};
+    size_t zerocopy_threshold_{0};  // 0: zero-copy disabled
+    uint32_t zerocopy_seq_{0};      // id of the next MSG_ZEROCOPY send
+    std::vector<ZeroCopySend> zerocopy_pending_;  // oldest first
+    ReadCallback read_cb_{nullptr};
+    FrameCallback frame_cb_{nullptr};
+    int (*frame_decoder_)(MessageBuffer&, Message&){nullptr};
+    CloseCallback close_cb_{nullptr};
     RemoveConnHandler remove_conn_handler_;
     TcpSocket conn_sk_;
     bool closed_{false};
     bool removed_{false};        // remove callback invoked
+    bool edge_triggered_{false};
+    bool unix_domain_{false};
+    bool read_paused_{false};
+    bool read_deferred_{false};  // dispatchRead() queued for the next round
+    bool peer_eof_{false};       // FIN read, close once the input is dispatched
+    bool coalesce_{false};
+    bool cork_{false};
+    bool flush_scheduled_{false};
+    bool async_recv_{false};     // multishot receive instead of EPOLLIN
+    bool async_send_{false};     // sendmsg operations instead of EPOLLOUT
+    int recv_op_{-1};
+    int send_op_{-1};
+    // Keeps the connection, and the buffer the kernel reads from, alive
+    // while send_op_ is in flight.
+    std::shared_ptr<TcpConn> send_self_;
+    std::unique_ptr<SendMsg> send_msg_;  // allocated with the first one
     TcpServer* owner_server_{nullptr};
 };
 
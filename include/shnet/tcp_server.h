@@ -1,12 +1,21 @@
 #pragma once
 
+#include <sys/types.h>
+
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
+#include <vector>
 
 #include "event_loop.h"
+#include "event_loop_thread_pool.h"
+#include "shnet/utils/shared_payload.h"
 #include "tcp_socket.h"
+#include "topic_registry.h"
 
 namespace shnet {
 
@@ -15,34 +24,170 @@ class TcpConn;
 class TcpServer {
    public:
     using ConnMap = std::unordered_map<int, std::shared_ptr<TcpConn>>;
-    using SubscriberSet = std::unordered_set<int>;
     using NewConnCallback = void (*)(std::shared_ptr<TcpConn>);
 
+    // How accepted connections are spread over the I/O loops.
+    enum class LoadBalance {
+        RoundRobin,
+        FdHash,
+    };
+
+    struct AcceptStats {
+        uint64_t accepted;
+        uint64_t rejected;          // accepted and closed while out of fds
+        uint64_t errors;
+        uint64_t budget_exhausted;  // wakeups that hit the accept budget
+    };
+
     static void acceptTrampoline(void* obj, uint32_t events);
+    static void acceptCompletionTrampoline(void* obj, const EventLoop::Completion& c);
+    static void resumeAcceptTrampoline(void* obj);
     static void removeConnTrampoline(void* obj, int fd);
 
     TcpServer(EventLoop*);
     ~TcpServer();
 
+    // Number of I/O loops, each on its own thread. Must be called before
+    // start(). With 0 (the default) every connection lives on the accepting
+    // loop; otherwise the accepting loop only accepts and each new connection
+    // is handed over to a sub-loop, where its callbacks run.
+    void setThreadNum(size_t num_threads) { num_threads_ = num_threads; }
+    void setLoadBalance(LoadBalance policy) { load_balance_ = policy; }
+
+    // Edge-triggered mode for listen sockets and accepted connections. Each
+    // wakeup accepts, reads and writes until EAGAIN, and connections keep
+    // EPOLLOUT registered instead of toggling it. Must be called before
+    // start().
+    void setEdgeTriggered(bool enable) { edge_triggered_ = enable; }
+
+    // Maximum connections accepted per listen socket wakeup. Loops with
+    // asynchronous I/O (io_uring) use a multishot accept instead, which hands
+    // over connections as the kernel accepts them.
+    void setAcceptBudget(size_t budget) { accept_budget_ = budget > 0 ? budget : 1; }
+
+    // Monotonic counters, safe to read from any thread. Sample them
+    // periodically to derive accept and rejection rates.
+    AcceptStats acceptStats() const;
+
+    // Sharded listening. Must be called before start().
+    //
+    // Instead of one listen socket handing connections over, every I/O loop
+    // opens its own SO_REUSEPORT listen socket and accepts for itself, so the
+    // kernel spreads incoming connections with no shared accept queue.
+    //
+    // With steer_by_cpu, the I/O threads are pinned to CPUs 0..n-1 and a
+    // classic BPF program (SO_ATTACH_REUSEPORT_CBPF) picks the shard running
+    // on the CPU that handled the incoming packet. The mapping is exact when
+    // the thread count equals the number of CPUs receiving network traffic;
+    // otherwise it degrades to cpu % n.
+    void setShardedListen(bool enable, bool steer_by_cpu = false) {
+        sharded_listen_ = enable;
+        steer_by_cpu_ = steer_by_cpu;
+    }
+
+    // Call on the thread of the loop passed to the constructor.
     void start(uint16_t port, NewConnCallback cb);
 
-    void subscribe(int fd);
-    void unsubscribe(int fd);
+    // Listens on an AF_UNIX stream socket instead; connections are the same
+    // TcpConn as over TCP. A path starting with '@' is an abstract-namespace
+    // address. A stale socket file at path is replaced, but one another
+    // server still listens on fails with EADDRINUSE. The file is removed
+    // again when the server is destroyed, unless it was replaced meanwhile.
+    // Throws std::system_error like start().
+    void startUnix(const std::string& path, NewConnCallback cb);
 
-    // Broadcast to all current subscribers.
+    // Topic subscriptions; see TopicRegistry for the filter syntax. A closed
+    // connection loses all of its subscriptions. Returns 0, or -EINVAL for a
+    // malformed filter.
+    int subscribe(int fd, std::string_view filter);
+    void unsubscribe(int fd, std::string_view filter);
+    // Subscription to the "" topic, which broadcast() without a topic uses.
+    void subscribe(int fd) { subscribe(fd, ""); }
+    void unsubscribe(int fd) { unsubscribe(fd, ""); }
+
+    // Broadcast to the current subscribers of topic.
     // Returns 0 on success, or last negative errno code if any send fails.
-    int broadcast(const char* data, size_t size);
+    // The payload is copied once into a SharedPayload; every subscriber that
+    // can't take it right away queues a reference, so the cost per subscriber
+    // doesn't grow with the payload size. Sends to subscribers living on
+    // another loop are queued to it as one task per loop; failures of those
+    // sends are not reported here.
+    int broadcast(std::string_view topic, const char* data, size_t size);
+    int broadcast(std::string_view topic, const SharedPayload::Ref& payload);
+    int broadcast(const char* data, size_t size) { return broadcast("", data, size); }
+    int broadcast(const SharedPayload::Ref& payload) { return broadcast("", payload); }
 
    private:
-    void handleAccept(uint32_t);
+    struct Listener {
+        Listener(TcpServer* s, EventLoop* l, int fd);
+        ~Listener();
+
+        TcpServer* server;
+        EventLoop* loop;
+        TcpSocket sk;
+        EventLoop::EventHandler handler;
+        // Reserved fd given up to shed connections on EMFILE.
+        int spare_fd;
+        uint32_t events{0};  // as registered
+        // Multishot accept in use instead of readiness, and its operation
+        // while armed (-1 otherwise).
+        bool multishot{false};
+        int accept_op{-1};
+        // Pending re-registration after accepting was paused, see shedConn().
+        EventLoop::TimerId retry_timer;
+        bool unix_domain{false};
+    };
+
+    struct AcceptCounters {
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> budget_exhausted{0};
+    };
+
+    static constexpr size_t DEFAULT_ACCEPT_BUDGET = 64;
+    // How long a listener out of fds and spare fd stops polling.
+    static constexpr uint64_t ACCEPT_RETRY_MS = 100;
+
+    void startLoopPool();
+    void listenOn(EventLoop* loop, uint16_t port);
+    void listenUnixOn(EventLoop* loop, const std::string& path);
+    void registerListener(EventLoop* loop, std::unique_ptr<Listener> listener);
+    int armListener(Listener&);
+
+    void handleAccept(Listener&, uint32_t);
+    void handleAcceptCompletion(Listener&, const EventLoop::Completion&);
+    void acceptBatch(Listener&);
+    void handOff(Listener&, int conn_fd);
+    bool shedConn(Listener&);
+    void pauseAccept(Listener&);
+    void resumeAccept(Listener&);
+    void newConn(int fd, EventLoop* loop, bool unix_domain);
     void removeConn(int fd);
 
+    EventLoop* selectLoop(int fd);
+
     EventLoop* ev_loop_;
     NewConnCallback new_conn_cb_;
-    EventLoop::EventHandler accept_handler_;
-    TcpSocket listen_sk_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
+    // Socket file to remove on destruction, and its identity when bound.
+    std::string unix_path_;
+    dev_t unix_dev_{0};
+    ino_t unix_ino_{0};
+    size_t num_threads_{0};
+    LoadBalance load_balance_{LoadBalance::RoundRobin};
+    size_t accept_budget_{DEFAULT_ACCEPT_BUDGET};
+    AcceptCounters accept_counters_;
+    bool edge_triggered_{false};
+    bool sharded_listen_{false};
+    bool steer_by_cpu_{false};
+    std::unique_ptr<EventLoopThreadPool> loop_pool_;
+    // Guards conn_map_, topics_ and match_fds_, which are touched from every
+    // I/O loop.
+    std::mutex mutex_;
     ConnMap conn_map_;
-    SubscriberSet subscribers_;
+    TopicRegistry topics_;
+    std::vector<int> match_fds_;
 };
 
 }  // namespace shnet
\ No newline at end of file
@@ -6,9 +6,10 @@
 #include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <sys/uio.h>  // readv
+#include <sys/uio.h>  // readv, writev
 #include <unistd.h>
 
+#include "shnet/unix_address.h"
 #include "shnet/utils/noncopyable.h"
 
 namespace shnet {
@@ -19,6 +20,8 @@ class TcpSocket : noncopyable {
     ~TcpSocket();
 
     void setNoDelay();
+    // TCP_CORK: hold back partial segments until uncorked.
+    void setCork(bool on);
     void setReusable();
     void setNonBlocking();
     void setBlocking();
@@ -26,20 +29,43 @@ class TcpSocket : noncopyable {
     void setRcvBufSize(int rcvBufSize);
     void setSndBufSize(int sndBufSize);
 
+    // Attach a classic BPF program to this socket's SO_REUSEPORT group that
+    // selects the group member indexed by the current CPU (modulo groups).
+    // Returns 0 on success, -1 with errno set on failure.
+    int attachReusePortCpuBpf(uint32_t groups);
+
+    // Allows MSG_ZEROCOPY sends. Returns 0 on success, -1 with errno set on
+    // failure (e.g. kernels before 4.14).
+    int setZeroCopy();
+
     bool getTcpInfo(struct tcp_info*) const { return true; }
 
+    // Pending socket error (SO_ERROR), which reading clears.
+    int getError() const;
+
     int fd() const { return sockfd_; }
 
     int bind(uint16_t port);
+    int bind(const UnixAddress& addr);
     int listen();
     void shutdown();
     void close();
+    // Closes the current fd and takes ownership of fd.
+    void reset(int fd);
 
     ssize_t read(void* buf, size_t len);
     ssize_t readv(const struct iovec* iov, int iovcnt);
 
     ssize_t write(const void* buf, size_t len);
     ssize_t send(const void* buf, size_t len, int flags);
+    ssize_t writev(const struct iovec* iov, int iovcnt);
+    // Gather send via sendmsg(), so flags such as MSG_NOSIGNAL apply.
+    ssize_t sendv(const struct iovec* iov, int iovcnt, int flags);
+    // sendfile() of count bytes of in_fd from offset on.
+    ssize_t sendFile(int in_fd, off_t offset, size_t count);
+    // One message from the error queue (MSG_ERRQUEUE), e.g. zero-copy
+    // completions.
+    ssize_t recvErrorQueue(struct msghdr* msg);
 
    private:
     static constexpr int KEEP_ALIVE = 1;
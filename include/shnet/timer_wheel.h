@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <vector>
+
+#include "shnet/utils/noncopyable.h"
+
+namespace shnet {
+
+// Hierarchical timing wheel with 1 ms ticks, owned by a single EventLoop.
+//
+// Level 0 has 256 slots of 1 ms; levels 1-4 have 64 slots, each 64 times
+// coarser than the level below, covering 2^32 ms (~49 days). Timers sit in
+// intrusive doubly linked slot lists, so add and cancel are O(1); a timer
+// is moved down at most once per level as its deadline approaches.
+//
+// Not thread-safe.
+class TimerWheel : noncopyable {
+   public:
+    using Callback = void (*)(void* obj);
+
+    // gen 0 never refers to a live timer.
+    struct TimerId {
+        uint32_t index{0};
+        uint32_t gen{0};
+    };
+
+    explicit TimerWheel(uint64_t now_ms);
+
+    // Runs cb(obj) once at least delay_ms after now_ms. A delay of 0 fires on
+    // the next tick.
+    TimerId add(uint64_t now_ms, uint64_t delay_ms, Callback cb, void* obj);
+
+    // Returns false when the timer already fired or was cancelled.
+    bool cancel(TimerId id);
+
+    // Fires every timer due at or before now_ms.
+    void advance(uint64_t now_ms);
+
+    // Milliseconds until advance() has work to do (a timer is due or a
+    // coarser level has to be cascaded), or -1 without pending timers.
+    int64_t nextTimeout(uint64_t now_ms) const;
+
+    size_t size() const { return size_; }
+
+   private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr int LEVELS = 5;
+    static constexpr int L0_BITS = 8;
+    static constexpr int LN_BITS = 6;
+    static constexpr uint32_t L0_SIZE = 1u << L0_BITS;
+    static constexpr uint32_t LN_SIZE = 1u << LN_BITS;
+    static constexpr uint64_t MAX_DELAY = (1ull << (L0_BITS + 4 * LN_BITS)) - 1;
+
+    struct Node {
+        uint64_t expire;
+        Callback cb;
+        void* obj;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t gen;
+        uint16_t level;
+        uint16_t slot;
+    };
+
+    static int shiftOf(int level) { return level == 0 ? 0 : L0_BITS + (level - 1) * LN_BITS; }
+
+    uint32_t& head(int level, uint32_t slot) { return slots_[level][slot]; }
+
+    uint32_t allocNode();
+    void freeNode(uint32_t idx);
+
+    void place(uint32_t idx);
+    void link(uint32_t idx, int level, uint32_t slot);
+    void unlink(uint32_t idx);
+
+    void cascade(int level, uint32_t slot);
+    void expire(uint32_t slot);
+
+    // First non-empty level-0 slot in [from, to), or -1.
+    int findSlot(uint32_t from, uint32_t to) const;
+
+    uint64_t current_;
+    size_t size_{0};
+    size_t upper_size_{0};  // timers on levels 1 and up
+    std::vector<Node> nodes_;
+    uint32_t free_list_{NIL};
+    std::array<std::array<uint32_t, L0_SIZE>, LEVELS> slots_;
+    // One bit per non-empty level-0 slot, to find the next deadline quickly.
+    std::array<uint64_t, L0_SIZE / 64> l0_bitmap_{};
+};
+
+}  // namespace shnet
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "shnet/utils/noncopyable.h"
+
+namespace shnet {
+
+// Subscriptions of connections (by fd) to topics, as used by TcpServer.
+//
+// Topics are '/'-separated levels, e.g. "prices/eu/btc". A filter is either
+// a plain topic or a pattern where a whole level is '+' (exactly one level)
+// or the last level is '#' (any number of remaining levels, including none):
+// "prices/+/btc", "prices/#". As in MQTT, wildcards at the first level don't
+// match topics starting with '$'.
+//
+// Plain filters live in a hash map of dense fd vectors, so publishing to a
+// topic nobody subscribed by pattern is a single lookup followed by a
+// linear scan of its subscribers. Patterns live in a trie keyed by level;
+// matching walks only the branches the topic can reach. Either way a publish
+// costs O(levels + matching subscribers), not O(all subscribers).
+// Subscribing and unsubscribing cost O(levels + filters held by the fd):
+// every subscription remembers its slot in the subscriber vector and is
+// swapped out of it, however many others share the filter.
+//
+// Not thread-safe; TcpServer guards it with its mutex.
+class TopicRegistry : noncopyable {
+   public:
+    TopicRegistry();
+
+    // Returns 0, or -EINVAL for a malformed filter (a wildcard mixed with
+    // other characters in a level, or '#' before the last level).
+    // Subscribing twice to the same filter is a no-op.
+    int subscribe(int fd, std::string_view filter);
+    // Returns false when fd wasn't subscribed to filter.
+    bool unsubscribe(int fd, std::string_view filter);
+    void unsubscribeAll(int fd);
+
+    // Appends every fd with a filter matching topic to out, each fd once.
+    void match(std::string_view topic, std::vector<int>& out);
+
+    bool empty() const { return filters_.empty(); }
+
+   private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    template <typename T>
+    using StringMap = std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+    // One filter held by an fd, and where the fd sits in that filter's
+    // subscriber vector, so removal is a swap with the last entry.
+    struct Subscription {
+        std::string filter;
+        uint32_t slot;
+    };
+
+    struct Node {
+        StringMap<uint32_t> children;
+        uint32_t plus{NIL};
+        uint32_t hash{NIL};
+        std::vector<int> fds;
+    };
+
+    static bool isPattern(std::string_view filter);
+    static bool isValid(std::string_view filter);
+
+    // Trie node for a pattern; creates the path when create is set, else
+    // returns NIL when it doesn't exist.
+    uint32_t patternNode(std::string_view filter, bool create);
+    // Drops fd from slot of filter's subscribers and re-points the entry
+    // moved into its place; the Subscription of fd itself is left alone.
+    void removeFd(int fd, const Subscription& sub);
+    void matchNode(uint32_t idx, std::string_view topic, size_t pos, std::vector<int>& out);
+    void collect(const std::vector<int>& fds, std::vector<int>& out);
+
+    StringMap<std::vector<int>> exact_;
+    std::vector<Node> nodes_;  // nodes_[0] is the root
+    size_t pattern_subs_{0};
+    // Filters held by each fd, for duplicate checks, removal and
+    // unsubscribeAll(). An fd holds few, so they are searched linearly.
+    std::unordered_map<int, std::vector<Subscription>> filters_;
+    // Per-fd stamp of the last match() that emitted it, to drop duplicates
+    // when several filters of one fd match.
+    std::vector<uint32_t> seen_;
+    uint32_t epoch_{0};
+};
+
+}  // namespace shnet
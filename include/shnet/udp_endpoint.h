@@ -0,0 +1,115 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "shnet/utils/noncopyable.h"
+#include "udp_socket.h"
+
+namespace shnet {
+
+// One received or to-be-sent datagram. Received datagrams point into the
+// endpoint's receive arena and are valid until the callback returns.
+struct Datagram {
+    const char* data;
+    size_t size;
+    sockaddr_in peer;
+};
+
+// IPv4 UDP socket driven by an EventLoop. Reads drain the socket with
+// recvmmsg() into a fixed arena of BATCH_SIZE slots and hand every batch to
+// the receive callback at once; sends go out with sendmmsg(). Sends are not
+// buffered: a full socket buffer shows up as a short count or -EAGAIN, and
+// UDP callers are expected to drop or retry themselves.
+//
+// Not thread-safe; use it on the thread of its loop.
+class UdpEndpoint : noncopyable {
+   public:
+    using ReceiveCallback = void (*)(UdpEndpoint* endpoint, std::span<const Datagram> batch);
+
+    explicit UdpEndpoint(EventLoop* loop, size_t max_datagram = DEFAULT_MAX_DATAGRAM);
+    ~UdpEndpoint();
+
+    // Binds to ip:port ("0.0.0.0" for any) and starts receiving. Returns 0 or
+    // a negative errno.
+    int bind(const std::string& ip, uint16_t port);
+
+    void setReceiveCallback(ReceiveCallback cb) { recv_cb_ = cb; }
+
+    // Lets the kernel coalesce consecutive datagrams of a flow into one
+    // receive (UDP GRO, Linux 5.0+). The batch handed to the callback is
+    // split back into the original datagrams. Call before bind(). Returns 0
+    // or a negative errno; receiving works either way.
+    int enableGro();
+
+    void setRcvBufSize(int size) { sk_.setRcvBufSize(size); }
+    void setSndBufSize(int size) { sk_.setSndBufSize(size); }
+    void setReusable() { sk_.setReusable(); }
+
+    // Returns 1 if the datagram was handed to the kernel, else a negative errno.
+    int sendTo(const sockaddr_in& peer, const char* data, size_t size);
+
+    // Sends the datagrams with one sendmmsg() per BATCH_SIZE of them. Returns
+    // how many were handed to the kernel, or a negative errno if none was.
+    int send(std::span<const Datagram> datagrams);
+
+    // Sends data to one peer as consecutive datagrams of `segment` bytes (the
+    // last one may be shorter). Uses UDP GSO, one sendmsg() for up to
+    // MAX_GSO_SEGMENTS datagrams, when the kernel supports it and falls back to
+    // sendmmsg() otherwise. Returns the number of datagrams sent or a negative
+    // errno if none was.
+    int sendSegmented(const sockaddr_in& peer, const char* data, size_t size, size_t segment);
+
+    // Datagrams dropped because they did not fit a receive slot.
+    uint64_t truncatedCount() const { return truncated_; }
+
+    int fd() const { return sk_.fd(); }
+    EventLoop* getEventLoop() const { return ev_loop_; }
+
+    static constexpr size_t DEFAULT_MAX_DATAGRAM = 2048;
+    static constexpr unsigned int BATCH_SIZE = 64;
+    // recvmmsg() calls per readiness event before yielding to other fds.
+    static constexpr int MAX_BATCHES_PER_EVENT = 16;
+    // A GRO receive holds at most one 64 KiB IP packet worth of datagrams.
+    static constexpr size_t GRO_SLOT_SIZE = 65536;
+    static constexpr size_t MAX_GSO_SEGMENTS = 64;
+    static constexpr size_t MAX_GSO_BYTES = 65507;
+
+   private:
+    static void ioTrampoline(void*, uint32_t);
+
+    void handleRead();
+    void allocArena();
+    int sendSlices(const sockaddr_in& peer, const char* data, size_t size, size_t segment);
+
+    EventLoop* ev_loop_;
+    UdpSocket sk_;
+    EventLoop::EventHandler io_handler_;
+    ReceiveCallback recv_cb_ = nullptr;
+
+    size_t max_datagram_;
+    size_t slot_size_;
+    // BATCH_SIZE receive slots, their iovecs/headers and control buffers,
+    // set up once and reused by every recvmmsg().
+    std::unique_ptr<char[]> arena_;
+    std::vector<char> control_;
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<sockaddr_in> peers_;
+    std::vector<Datagram> batch_;
+
+    uint64_t truncated_ = 0;
+    bool registered_ = false;
+    bool gro_ = false;
+    bool gso_ = true;
+};
+
+}  // namespace shnet
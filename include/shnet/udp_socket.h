@@ -0,0 +1,51 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "shnet/utils/noncopyable.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace shnet {
+
+// Owns a UDP socket fd; the datagram counterpart of TcpSocket. See
+// UdpEndpoint for the EventLoop-driven side.
+class UdpSocket : noncopyable {
+   public:
+    explicit UdpSocket(int fd);
+    ~UdpSocket();
+
+    void setReusable();
+    void setRcvBufSize(int rcvBufSize);
+    void setSndBufSize(int sndBufSize);
+
+    // Generic receive offload: the kernel may coalesce datagrams of one flow
+    // into a single receive, reporting their size in a UDP_GRO control
+    // message. Returns 0 on success, -1 with errno set on failure (e.g.
+    // kernels before 5.0).
+    int setGro(bool enable);
+
+    int fd() const { return sockfd_; }
+
+    int bind(const sockaddr_in& addr);
+    void close();
+
+    // recvmmsg()/sendmmsg() without blocking; number of messages or -1.
+    int recvBatch(struct mmsghdr* msgs, unsigned int n);
+    int sendBatch(struct mmsghdr* msgs, unsigned int n);
+    ssize_t sendMsg(const struct msghdr* msg);
+
+   private:
+    int sockfd_;
+};
+
+}  // namespace shnet
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+namespace shnet {
+
+// AF_UNIX socket address. A path starting with '@' names a socket in the
+// Linux abstract namespace: it has no filesystem entry and disappears with
+// its last fd. Paths that don't fit sun_path leave the address invalid.
+class UnixAddress {
+   public:
+    explicit UnixAddress(std::string_view path) {
+        std::memset(&addr_, 0, sizeof(addr_));
+        addr_.sun_family = AF_UNIX;
+        const bool abstract = !path.empty() && path[0] == '@';
+        // Filesystem paths need room for the terminating NUL.
+        if (path.empty() || path.size() > sizeof(addr_.sun_path) - (abstract ? 0 : 1)) {
+            return;
+        }
+        std::memcpy(addr_.sun_path, path.data(), path.size());
+        if (abstract) {
+            addr_.sun_path[0] = '\0';
+            len_ = offsetof(sockaddr_un, sun_path) + path.size();
+        } else {
+            len_ = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+        }
+    }
+
+    bool valid() const { return len_ != 0; }
+    bool isAbstract() const { return valid() && addr_.sun_path[0] == '\0'; }
+
+    const sockaddr* sockAddr() const { return reinterpret_cast<const sockaddr*>(&addr_); }
+    socklen_t length() const { return len_; }
+    // Filesystem path, only meaningful when !isAbstract().
+    const char* path() const { return addr_.sun_path; }
+
+   private:
+    sockaddr_un addr_;
+    socklen_t len_{0};
+};
+
+}  // namespace shnet
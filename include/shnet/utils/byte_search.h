@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace shnet {
+
+// Offset of the first occurrence of delim[0, delim_len) in data[0, size), or
+// size when there is none. delim_len must be at least 1.
+//
+// Single bytes go to memchr. Longer delimiters are vectorized on x86:
+// candidates are found by comparing the first and the last delimiter byte at
+// their respective offsets 16 (SSE2) or 32 (AVX2) positions at a time, so
+// "\r\n" needs no verification at all and longer delimiters only a memcmp
+// per candidate. AVX2 is picked at runtime when the CPU has it; other
+// architectures use a scalar fallback.
+size_t findDelimiter(const char* data, size_t size, const char* delim, size_t delim_len);
+
+}  // namespace shnet
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "noncopyable.h"
+#include "shared_payload.h"
+
+namespace shnet {
+
+// Free lists of fixed-size buffer blocks and of the small segments that
+// reference shared payloads or files, so chained buffers don't hit the allocator on
+// every append. Each EventLoop owns one; not thread-safe.
+class BlockPool : noncopyable {
+   public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+    // Idle blocks kept for reuse; the rest go back to the allocator.
+    static constexpr size_t DEFAULT_MAX_CACHED = 1024;
+
+    // One link of a chain: a range of bytes that is either the inline
+    // storage of a Block, part of a SharedPayload, or a range of a file
+    // (file_fd >= 0) that is never read into memory.
+    struct Segment {
+        Segment* next;
+        const char* base;
+        uint32_t begin;  // first unread byte
+        uint32_t end;    // one past the last written byte
+        SharedPayload* payload;
+        off_t file_offset;  // file position of byte 0
+        int file_fd;
+        bool owns_file;  // closes file_fd on release
+        bool zerocopy;   // flush with MSG_ZEROCOPY
+    };
+
+    struct Block {
+        Segment seg;
+        char data[BLOCK_SIZE];
+    };
+
+    explicit BlockPool(size_t max_cached = DEFAULT_MAX_CACHED) : max_cached_(max_cached) {}
+
+    ~BlockPool() {
+        while (free_blocks_ != nullptr) {
+            Segment* next = free_blocks_->next;
+            delete reinterpret_cast<Block*>(free_blocks_);
+            free_blocks_ = next;
+        }
+        while (free_segments_ != nullptr) {
+            Segment* next = free_segments_->next;
+            delete free_segments_;
+            free_segments_ = next;
+        }
+    }
+
+    // A segment over a fresh block's storage.
+    Segment* acquire() {
+        Segment* seg = free_blocks_;
+        if (seg != nullptr) {
+            free_blocks_ = seg->next;
+            --cached_;
+        } else {
+            Block* block = new Block;
+            seg = &block->seg;
+            seg->base = block->data;
+        }
+        seg->next = nullptr;
+        seg->begin = seg->end = 0;
+        seg->payload = nullptr;
+        seg->file_fd = -1;
+        seg->zerocopy = false;
+        return seg;
+    }
+
+    // A segment over size bytes of payload from offset on; adopts one
+    // reference.
+    Segment* acquire(SharedPayload* payload, size_t offset, uint32_t size) {
+        Segment* seg = acquireSegment();
+        seg->base = payload->data() + offset;
+        seg->begin = 0;
+        seg->end = size;
+        seg->payload = payload;
+        return seg;
+    }
+
+    // A segment over size bytes of fd from offset on; adopts fd if owns_file.
+    Segment* acquire(int fd, off_t offset, uint32_t size, bool owns_file) {
+        Segment* seg = acquireSegment();
+        seg->begin = 0;
+        seg->end = size;
+        seg->file_offset = offset;
+        seg->file_fd = fd;
+        seg->owns_file = owns_file;
+        return seg;
+    }
+
+    void release(Segment* seg) {
+        if (seg->payload != nullptr || seg->file_fd >= 0) {
+            if (seg->payload != nullptr) {
+                seg->payload->unref();
+            } else if (seg->owns_file) {
+                ::close(seg->file_fd);
+            }
+            if (cached_segments_ >= max_cached_) {
+                delete seg;
+                return;
+            }
+            seg->next = free_segments_;
+            free_segments_ = seg;
+            ++cached_segments_;
+            return;
+        }
+        if (cached_ >= max_cached_) {
+            delete reinterpret_cast<Block*>(seg);
+            return;
+        }
+        seg->next = free_blocks_;
+        free_blocks_ = seg;
+        ++cached_;
+    }
+
+    size_t cached() const { return cached_; }
+
+   private:
+    Segment* acquireSegment() {
+        Segment* seg = free_segments_;
+        if (seg != nullptr) {
+            free_segments_ = seg->next;
+            --cached_segments_;
+        } else {
+            seg = new Segment;
+        }
+        seg->next = nullptr;
+        seg->base = nullptr;
+        seg->payload = nullptr;
+        seg->file_fd = -1;
+        seg->zerocopy = false;
+        return seg;
+    }
+
+    Segment* free_blocks_{nullptr};
+    Segment* free_segments_{nullptr};
+    size_t cached_{0};
+    size_t cached_segments_{0};
+    size_t max_cached_;
+};
+
+// Byte queue made of pool blocks.
+//
+// Appending copies into the tail block and links new blocks as needed;
+// consuming unlinks drained blocks back into the pool. Neither moves bytes
+// that are already buffered, so both cost O(bytes appended / consumed)
+// however much is queued. An empty buffer holds no blocks. append() queues a
+// SharedPayload by reference, without copying it, and appendFile() a file
+// range that is meant for sendfile(). Readable data is exposed as iovec
+// views, ready for writev()/sendmsg().
+//
+// capacity is a soft limit for getFreeSize(), which only counts bytes held in
+// memory; write() never fails.
+class ChainBuffer : noncopyable {
+   public:
+    using Segment = BlockPool::Segment;
+
+    ChainBuffer(BlockPool* pool, size_t capacity) : pool_(pool), capacity_(capacity) {}
+    ~ChainBuffer() { clear(); }
+
+    std::size_t readableSize() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    std::size_t getBufferSize() const { return capacity_; }
+    std::size_t getFreeSize() const {
+        const size_t held = size_ - file_size_;
+        return held < capacity_ ? capacity_ - held : 0;
+    }
+
+    void write(const void* data, std::size_t size) {
+        const char* src = static_cast<const char*>(data);
+        while (size > 0) {
+            if (tail_ == nullptr || tail_->payload != nullptr || tail_->file_fd >= 0 ||
+                tail_->end == BlockPool::BLOCK_SIZE) {
+                link(pool_->acquire());
+            }
+            const size_t n = std::min<size_t>(size, BlockPool::BLOCK_SIZE - tail_->end);
+            memcpy(const_cast<char*>(tail_->base) + tail_->end, src, n);
+            tail_->end += static_cast<uint32_t>(n);
+            size_ += n;
+            src += n;
+            size -= n;
+        }
+    }
+
+    // Queues payload from offset on, sharing its bytes. A zerocopy segment
+    // is meant to be flushed on its own, see peekZeroCopy().
+    void append(const SharedPayload::Ref& payload, std::size_t offset = 0, bool zerocopy = false) {
+        if (offset >= payload->size()) {
+            return;
+        }
+        size_ += payload->size() - offset;
+        // Segment ranges are 32-bit; each piece holds its own reference.
+        while (offset < payload->size()) {
+            const size_t n = std::min<size_t>(payload->size() - offset, MAX_SEGMENT);
+            payload->ref();
+            Segment* seg = pool_->acquire(payload.get(), offset, static_cast<uint32_t>(n));
+            seg->zerocopy = zerocopy;
+            link(seg);
+            offset += n;
+        }
+    }
+
+    // Queues size bytes of fd from offset on and takes ownership of fd, which
+    // is closed once they were consumed or the buffer is cleared.
+    void appendFile(int fd, off_t offset, std::size_t size) {
+        if (size == 0) {
+            ::close(fd);
+            return;
+        }
+        size_ += size;
+        file_size_ += size;
+        // Segment ranges are 32-bit; the last piece owns the descriptor.
+        while (size > MAX_SEGMENT) {
+            link(pool_->acquire(fd, offset, MAX_SEGMENT, false));
+            offset += MAX_SEGMENT;
+            size -= MAX_SEGMENT;
+        }
+        link(pool_->acquire(fd, offset, static_cast<uint32_t>(size), true));
+    }
+
+    void readCommit(std::size_t size) {
+        size = std::min(size, size_);
+        size_ -= size;
+        while (size > 0) {
+            const size_t avail = head_->end - head_->begin;
+            if (head_->file_fd >= 0) {
+                file_size_ -= std::min(size, avail);
+            }
+            if (size < avail) {
+                head_->begin += static_cast<uint32_t>(size);
+                return;
+            }
+            size -= avail;
+            popSegment();
+        }
+        if (size_ == 0 && head_ != nullptr) {
+            popSegment();
+        }
+    }
+
+    // Views of the readable bytes, oldest first, at most max_iov of them and
+    // ending before a file segment or a zerocopy segment that isn't the
+    // first. Returns the number filled.
+    int peek(struct iovec* iov, int max_iov) const {
+        int n = 0;
+        for (Segment* b = head_; b != nullptr && n < max_iov; b = b->next) {
+            if (b->file_fd >= 0 || (b->zerocopy && n > 0)) {
+                break;
+            }
+            if (b->end > b->begin) {
+                iov[n].iov_base = const_cast<char*>(b->base + b->begin);
+                iov[n].iov_len = b->end - b->begin;
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    // The payload of the first segment when it was appended for zero-copy,
+    // with its unread bytes in *iov; nullptr otherwise.
+    SharedPayload* peekZeroCopy(struct iovec* iov) const {
+        if (head_ == nullptr || !head_->zerocopy) {
+            return nullptr;
+        }
+        iov->iov_base = const_cast<char*>(head_->base + head_->begin);
+        iov->iov_len = head_->end - head_->begin;
+        return head_->payload;
+    }
+
+    // The descriptor of the first segment when it is a file range, with the
+    // position and length of its unread bytes; -1 otherwise.
+    int peekFile(off_t* offset, std::size_t* size) const {
+        if (head_ == nullptr || head_->file_fd < 0) {
+            return -1;
+        }
+        *offset = head_->file_offset + head_->begin;
+        *size = head_->end - head_->begin;
+        return head_->file_fd;
+    }
+
+    void clear() {
+        while (head_ != nullptr) {
+            popSegment();
+        }
+        size_ = 0;
+        file_size_ = 0;
+    }
+
+   private:
+    // Largest payload or file range one segment covers.
+    static constexpr uint32_t MAX_SEGMENT = 1u << 30;
+
+    void link(Segment* seg) {
+        if (tail_ != nullptr) {
+            tail_->next = seg;
+        } else {
+            head_ = seg;
+        }
+        tail_ = seg;
+    }
+
+    void popSegment() {
+        Segment* seg = head_;
+        head_ = seg->next;
+        if (head_ == nullptr) {
+            tail_ = nullptr;
+        }
+        pool_->release(seg);
+    }
+
+    BlockPool* pool_;
+    Segment* head_{nullptr};
+    Segment* tail_{nullptr};
+    std::size_t size_{0};
+    std::size_t file_size_{0};  // part of size_ in file segments
+    std::size_t capacity_;
+};
+
+}  // namespace shnet
@@ -5,8 +5,12 @@
 #include <sys/uio.h>
 
 #include <cstring>
+#include <string_view>
 #include <vector>
 
+#include "byte_search.h"
+#include "noncopyable.h"
+
 namespace shnet {
 
 struct Message {
@@ -14,30 +18,92 @@ struct Message {
     size_t size_;
 };
 
+// Recycles MessageBuffer storage among the connections of one loop, so a
+// connection only holds a buffer while it has unread data. Buffers that grew
+// beyond MAX_CACHED_BUFFER_SIZE are freed instead of cached. Not thread-safe.
+class MessageBufferPool : noncopyable {
+   public:
+    static constexpr size_t DEFAULT_MAX_CACHED = 256;
+    static constexpr size_t MAX_CACHED_BUFFER_SIZE = 1 << 20;
+
+    explicit MessageBufferPool(size_t max_cached = DEFAULT_MAX_CACHED)
+        : max_cached_(max_cached) {}
+
+    std::vector<char> acquire(size_t size) {
+        if (free_.empty()) {
+            return std::vector<char>(size);
+        }
+        // Most recently released first: its pages are likely still cached.
+        std::vector<char> buffer = std::move(free_.back());
+        free_.pop_back();
+        if (buffer.size() < size) {
+            buffer.resize(size);
+        }
+        return buffer;
+    }
+
+    void release(std::vector<char>&& buffer) {
+        if (free_.size() < max_cached_ && buffer.size() <= MAX_CACHED_BUFFER_SIZE) {
+            free_.push_back(std::move(buffer));
+        }
+        buffer = std::vector<char>();
+    }
+
+    size_t cached() const { return free_.size(); }
+
+   private:
+    std::vector<std::vector<char>> free_;
+    size_t max_cached_;
+};
+
 class MessageBuffer {
    public:
     MessageBuffer(size_t size = DEFAULT_SIZE) : read_pos_(0), write_pos_(0) {
         buffer_.resize(size);
     }
 
+    // Lazily backed by pool: no storage until acquire() or the first write,
+    // and release() hands it back once everything was read.
+    MessageBuffer(MessageBufferPool* pool, size_t size = DEFAULT_SIZE)
+        : pool_(pool), size_(size), read_pos_(0), write_pos_(0) {}
+
+    ~MessageBuffer() {
+        if (pool_ != nullptr && !buffer_.empty()) {
+            pool_->release(std::move(buffer_));
+        }
+    }
+
     MessageBuffer(const MessageBuffer&) = delete;
     MessageBuffer& operator=(const MessageBuffer&) = delete;
 
     MessageBuffer(MessageBuffer&& other) noexcept
-        : buffer_(std::move(other.buffer_)),
+        : pool_(other.pool_),
+          size_(other.size_),
+          buffer_(std::move(other.buffer_)),
           read_pos_(other.read_pos_),
-          write_pos_(other.write_pos_) {
+          write_pos_(other.write_pos_),
+          scan_pos_(other.scan_pos_),
+          scan_key_(other.scan_key_) {
         other.read_pos_ = 0;
         other.write_pos_ = 0;
+        other.scan_pos_ = 0;
     }
 
     MessageBuffer& operator=(MessageBuffer&& other) noexcept {
         if (this != &other) {
+            if (pool_ != nullptr && !buffer_.empty()) {
+                pool_->release(std::move(buffer_));
+            }
+            pool_ = other.pool_;
+            size_ = other.size_;
             buffer_ = std::move(other.buffer_);
             read_pos_ = other.read_pos_;
             write_pos_ = other.write_pos_;
+            scan_pos_ = other.scan_pos_;
+            scan_key_ = other.scan_key_;
             other.read_pos_ = 0;
             other.write_pos_ = 0;
+            other.scan_pos_ = 0;
         }
         return *this;
     }
@@ -56,25 +122,36 @@ class MessageBuffer {
     Message getAllData() { return {readPointer(), readableSize()}; }
 
     Message getDataUntil(char terminator = 0) {
-        char* data = readPointer();
-        std::size_t active_size = readableSize();
-        for (std::size_t i = 0; i < active_size; ++i) {
-            if (data[i] == terminator) {
-                return {data, i};  // terminator not included
-            }
-        }
-        return {nullptr, 0};  // not found
+        return getDataUntil(std::string_view(&terminator, 1));
     }
 
-    Message getDataUntilCRLF() {
-        char* data = readPointer();
-        std::size_t active_size = readableSize();
-        for (std::size_t i = 0; i + 1 < active_size; ++i) {
-            if (data[i] == '\r' && data[i + 1] == '\n') {
-                return {data, i};  // terminator not included
-            }
+    Message getDataUntilCRLF() { return getDataUntil(std::string_view("\r\n", 2)); }
+
+    // Data before the first delimiter (not included), or {nullptr, 0} when
+    // there is none yet. A search remembers where it stopped, so asking again
+    // for the same delimiter after more data arrived only scans the new
+    // bytes instead of the whole line again. Delimiters longer than
+    // MAX_RESUMABLE_DELIMITER are searched from the start every time.
+    Message getDataUntil(std::string_view delimiter) {
+        const size_t len = delimiter.size();
+        if (len == 0 || readableSize() < len) {
+            return {nullptr, 0};
+        }
+        const uint64_t key = scanKey(delimiter);
+        size_t from = read_pos_;
+        if (key != 0 && key == scan_key_ && scan_pos_ > read_pos_) {
+            from = scan_pos_;
+        }
+        const size_t pos =
+            from + findDelimiter(buffer_.data() + from, write_pos_ - from, delimiter.data(), len);
+        scan_key_ = key;
+        if (pos == write_pos_) {
+            // A delimiter may still straddle the end of what is there.
+            scan_pos_ = write_pos_ - (len - 1);
+            return {nullptr, 0};
         }
-        return {nullptr, 0};  // not found
+        scan_pos_ = pos;
+        return {readPointer(), pos - read_pos_};  // delimiter not included
     }
 
     char* writePointer() { return buffer_.data() + write_pos_; }
@@ -109,14 +186,31 @@ class MessageBuffer {
     void shrink() {
         if (read_pos_) {
             memmove(buffer_.data(), buffer_.data() + read_pos_, readableSize());
+            scan_pos_ = scan_pos_ > read_pos_ ? scan_pos_ - read_pos_ : 0;
             write_pos_ -= read_pos_;
             read_pos_ = 0;
         }
     }
 
+    // borrow storage from the pool if there is none
+    void acquire() {
+        if (buffer_.empty() && pool_ != nullptr) {
+            buffer_ = pool_->acquire(size_);
+        }
+    }
+
+    // return the storage to the pool once everything was read
+    void release() {
+        if (pool_ != nullptr && !buffer_.empty() && empty()) {
+            pool_->release(std::move(buffer_));
+            read_pos_ = write_pos_ = scan_pos_ = 0;
+        }
+    }
+
     // ensure a write space of given size
     // may trigger resize
     void prepare(std::size_t size) {
+        acquire();
         if (getFreeSize() < size) {
             // no enough room
             // shrink and expand
@@ -130,11 +224,28 @@ class MessageBuffer {
     }
 
     static constexpr size_t DEFAULT_SIZE = 1 << 16;
+    static constexpr size_t MAX_RESUMABLE_DELIMITER = 7;
 
    private:
+    // Identifies a delimiter of up to MAX_RESUMABLE_DELIMITER bytes; 0 for
+    // longer ones.
+    static uint64_t scanKey(std::string_view delimiter) {
+        if (delimiter.size() > MAX_RESUMABLE_DELIMITER) {
+            return 0;
+        }
+        uint64_t key = static_cast<uint64_t>(delimiter.size()) << 56;
+        memcpy(&key, delimiter.data(), delimiter.size());
+        return key;
+    }
+
+    MessageBufferPool* pool_{nullptr};
+    std::size_t size_{DEFAULT_SIZE};
     std::vector<char> buffer_;
     std::size_t read_pos_;
     std::size_t write_pos_;
+    // Where the last failed search for scan_key_ can resume.
+    std::size_t scan_pos_{0};
+    uint64_t scan_key_{0};
 };
 
 }
\ No newline at end of file
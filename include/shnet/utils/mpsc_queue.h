@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+#include "noncopyable.h"
+
+namespace shnet {
+
+// Lock-free multi-producer single-consumer queue.
+//
+// Producers push onto an atomic list head with a CAS; the consumer detaches
+// the whole list with a single exchange and replays it in FIFO order. One
+// drain therefore handles every item posted so far, and items pushed while a
+// drain runs (including by the consumer itself) are left for the next drain.
+template <typename T>
+class MpscQueue : noncopyable {
+   public:
+    MpscQueue() = default;
+
+    ~MpscQueue() {
+        drain([](T&) {});
+    }
+
+    // Thread-safe.
+    void push(T value) {
+        Node* node = new Node{std::move(value), head_.load(std::memory_order_relaxed)};
+        // seq_cst so a push and a consumer-side flag (see EventLoop) can't
+        // both miss each other.
+        while (!head_.compare_exchange_weak(node->next, node, std::memory_order_seq_cst,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    bool empty() const { return head_.load(std::memory_order_acquire) == nullptr; }
+
+    // Consumer only. Calls f on every item pushed before the call, oldest
+    // first, and returns how many were handled.
+    template <typename F>
+    size_t drain(F&& f) {
+        Node* node = head_.exchange(nullptr, std::memory_order_seq_cst);
+        if (node == nullptr) {
+            return 0;
+        }
+
+        // The list is newest-first; reverse it.
+        Node* fifo = nullptr;
+        while (node != nullptr) {
+            Node* next = node->next;
+            node->next = fifo;
+            fifo = node;
+            node = next;
+        }
+
+        size_t n = 0;
+        while (fifo != nullptr) {
+            Node* next = fifo->next;
+            f(fifo->value);
+            delete fifo;
+            fifo = next;
+            ++n;
+        }
+        return n;
+    }
+
+   private:
+    struct Node {
+        T value;
+        Node* next;
+    };
+
+    std::atomic<Node*> head_{nullptr};
+};
+
+}  // namespace shnet
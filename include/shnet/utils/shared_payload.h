@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "noncopyable.h"
+
+namespace shnet {
+
+// Immutable bytes with an intrusive, thread-safe reference count. Send
+// buffers queue references to it instead of copies, so a payload sent to many
+// connections (see TcpServer::broadcast) is written to memory once, and
+// zero-copy sends keep a reference until the kernel is done with the pages.
+class SharedPayload : noncopyable {
+   public:
+    // Owning reference; copying one only bumps the count.
+    class Ref {
+       public:
+        Ref() = default;
+        Ref(const Ref& other) : payload_(other.payload_) {
+            if (payload_ != nullptr) {
+                payload_->ref();
+            }
+        }
+        Ref(Ref&& other) noexcept : payload_(std::exchange(other.payload_, nullptr)) {}
+        Ref& operator=(Ref other) noexcept {
+            std::swap(payload_, other.payload_);
+            return *this;
+        }
+        ~Ref() {
+            if (payload_ != nullptr) {
+                payload_->unref();
+            }
+        }
+
+        SharedPayload* get() const { return payload_; }
+        SharedPayload* operator->() const { return payload_; }
+        explicit operator bool() const { return payload_ != nullptr; }
+
+        // Hands the reference over to the caller, who must unref() it.
+        SharedPayload* release() { return std::exchange(payload_, nullptr); }
+
+       private:
+        friend class SharedPayload;
+        explicit Ref(SharedPayload* payload) : payload_(payload) {}
+
+        SharedPayload* payload_{nullptr};
+    };
+
+    using ReleaseCallback = void (*)(void* obj);
+
+    // Copies data; header and bytes share one allocation.
+    static Ref create(const void* data, size_t size) {
+        void* mem = ::operator new(sizeof(SharedPayload) + size);
+        char* bytes = static_cast<char*>(mem) + sizeof(SharedPayload);
+        memcpy(bytes, data, size);
+        return Ref(new (mem) SharedPayload(bytes, size, nullptr, nullptr));
+    }
+
+    // References caller-owned bytes without copying them. cb(obj) runs once
+    // the last reference is gone, i.e. no send buffer and no zero-copy send
+    // in flight uses the bytes anymore; until then they must not change. It
+    // runs on the thread that drops that reference.
+    static Ref wrap(const void* data, size_t size, ReleaseCallback cb, void* obj) {
+        return Ref(new SharedPayload(static_cast<const char*>(data), size, cb, obj));
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    void ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void unref() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ReleaseCallback cb = release_cb_;
+            void* obj = release_obj_;
+            this->~SharedPayload();
+            ::operator delete(this);
+            if (cb != nullptr) {
+                cb(obj);
+            }
+        }
+    }
+
+   private:
+    SharedPayload(const char* data, size_t size, ReleaseCallback cb, void* obj)
+        : data_(data), size_(size), release_cb_(cb), release_obj_(obj) {}
+
+    std::atomic<uint32_t> refs_{1};
+    const char* data_;
+    size_t size_;
+    ReleaseCallback release_cb_;
+    void* release_obj_;
+};
+
+}  // namespace shnet
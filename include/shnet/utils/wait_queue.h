@@ -0,0 +1,68 @@
+#pragma once
+
+#include <coroutine>
+
+#include "noncopyable.h"
+
+namespace shnet {
+
+// FIFO of suspended coroutines, resumed explicitly by the owner.
+//
+// Intrusive: each node lives in the awaiting coroutine's frame, so parking
+// allocates nothing. Single-threaded, like the loop that owns it.
+class WaitQueue : noncopyable {
+   public:
+    class Awaiter {
+       public:
+        explicit Awaiter(WaitQueue* queue) : queue_(queue) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) {
+            handle_ = h;
+            queue_->push(this);
+        }
+        void await_resume() const noexcept {}
+
+       private:
+        friend class WaitQueue;
+
+        WaitQueue* queue_;
+        std::coroutine_handle<> handle_;
+        Awaiter* next_{nullptr};
+    };
+
+    WaitQueue() = default;
+
+    // co_await queue.wait() parks the calling coroutine.
+    Awaiter wait() { return Awaiter(this); }
+
+    bool empty() const { return head_ == nullptr; }
+
+    // Resumes every coroutine parked before the call, oldest first. Those
+    // that park again while this runs wait for the next call.
+    void resumeAll() {
+        Awaiter* waiter = head_;
+        head_ = tail_ = nullptr;
+        while (waiter != nullptr) {
+            Awaiter* next = waiter->next_;
+            waiter->handle_.resume();
+            waiter = next;
+        }
+    }
+
+   private:
+    void push(Awaiter* waiter) {
+        waiter->next_ = nullptr;
+        if (tail_ != nullptr) {
+            tail_->next_ = waiter;
+        } else {
+            head_ = waiter;
+        }
+        tail_ = waiter;
+    }
+
+    Awaiter* head_{nullptr};
+    Awaiter* tail_{nullptr};
+};
+
+}  // namespace shnet
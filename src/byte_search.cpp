@@ -0,0 +1,128 @@
+#include "shnet/utils/byte_search.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHNET_X86_SIMD 1
+#endif
+
+namespace shnet {
+
+namespace {
+
+using SearchFn = size_t (*)(const char*, size_t, const char*, size_t);
+
+size_t findScalar(const char* data, size_t size, const char* delim, size_t delim_len) {
+    if (size < delim_len) {
+        return size;
+    }
+    const char* end = data + size - delim_len + 1;
+    for (const char* p = data; p < end; ++p) {
+        p = static_cast<const char*>(memchr(p, delim[0], end - p));
+        if (p == nullptr) {
+            break;
+        }
+        if (memcmp(p + 1, delim + 1, delim_len - 1) == 0) {
+            return p - data;
+        }
+    }
+    return size;
+}
+
+#ifdef SHNET_X86_SIMD
+
+// Checks the middle of a candidate whose first and last bytes matched.
+inline bool verify(const char* p, const char* delim, size_t delim_len) {
+    return delim_len <= 2 || memcmp(p + 1, delim + 1, delim_len - 2) == 0;
+}
+
+size_t findSse2(const char* data, size_t size, const char* delim, size_t delim_len) {
+    if (size < delim_len) {
+        return size;
+    }
+    const size_t last = delim_len - 1;
+    const size_t limit = size - last;  // candidate starts are < limit
+    const __m128i first_v = _mm_set1_epi8(delim[0]);
+    const __m128i last_v = _mm_set1_epi8(delim[last]);
+    size_t i = 0;
+    for (; i + 16 <= limit; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + last));
+        // bit k: data[i + k] == first and data[i + k + last] == last
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first_v), _mm_cmpeq_epi8(b, last_v)));
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (verify(data + pos, delim, delim_len)) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    const size_t rest = findScalar(data + i, size - i, delim, delim_len);
+    return i + rest;
+}
+
+__attribute__((target("avx2"))) size_t findAvx2(const char* data, size_t size,
+                                                const char* delim, size_t delim_len) {
+    if (size < delim_len) {
+        return size;
+    }
+    const size_t last = delim_len - 1;
+    const size_t limit = size - last;
+    const __m256i first_v = _mm256_set1_epi8(delim[0]);
+    const __m256i last_v = _mm256_set1_epi8(delim[last]);
+    size_t i = 0;
+    for (; i + 32 <= limit; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + last));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first_v), _mm256_cmpeq_epi8(b, last_v))));
+        while (mask != 0) {
+            const size_t pos = i + __builtin_ctz(mask);
+            if (verify(data + pos, delim, delim_len)) {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return i + findSse2(data + i, size - i, delim, delim_len);
+}
+
+SearchFn selectSearch() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &findAvx2 : &findSse2;
+}
+
+#else
+
+SearchFn selectSearch() { return &findScalar; }
+
+#endif
+
+size_t resolve(const char* data, size_t size, const char* delim, size_t delim_len);
+
+// Starts at resolve(), which swaps in the implementation for this CPU on the
+// first call; constant-initialized, so it is usable from static constructors.
+std::atomic<SearchFn> search_impl{&resolve};
+
+size_t resolve(const char* data, size_t size, const char* delim, size_t delim_len) {
+    SearchFn fn = selectSearch();
+    search_impl.store(fn, std::memory_order_relaxed);
+    return fn(data, size, delim, delim_len);
+}
+
+}  // namespace
+
+size_t findDelimiter(const char* data, size_t size, const char* delim, size_t delim_len) {
+    if (delim_len == 1) {
+        // libc's memchr is already vectorized for single bytes.
+        const void* hit = memchr(data, delim[0], size);
+        return hit != nullptr ? static_cast<const char*>(hit) - data : size;
+    }
+    return search_impl.load(std::memory_order_relaxed)(data, size, delim, delim_len);
+}
+
+}  // namespace shnet
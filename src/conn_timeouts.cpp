@@ -0,0 +1,97 @@
+#include "shnet/conn_timeouts.h"
+
+#include <algorithm>
+
+namespace shnet {
+
+inline void ConnTimeouts::timerTrampoline(void* obj) {
+    static_cast<ConnTimeouts*>(obj)->handleTimer();
+}
+
+void ConnTimeouts::setIdleTimeout(uint64_t ms) {
+    idle_ms_ = ms;
+    onActivity();
+    schedule(nextDeadline());
+}
+
+void ConnTimeouts::setReadTimeout(uint64_t ms) {
+    read_ms_ = ms;
+    schedule(nextDeadline());
+}
+
+void ConnTimeouts::setWriteTimeout(uint64_t ms) {
+    write_ms_ = ms;
+    schedule(nextDeadline());
+}
+
+void ConnTimeouts::setReadPending(bool pending) {
+    if (pending == (read_pending_since_ != 0)) {
+        return;
+    }
+    read_pending_since_ = pending ? loop_->now() : 0;
+    if (pending && read_ms_) {
+        schedule(read_pending_since_ + read_ms_);
+    }
+}
+
+void ConnTimeouts::setWritePending(bool pending) {
+    if (pending == (write_pending_since_ != 0)) {
+        return;
+    }
+    write_pending_since_ = pending ? loop_->now() : 0;
+    if (pending && write_ms_) {
+        schedule(write_pending_since_ + write_ms_);
+    }
+}
+
+void ConnTimeouts::stop() {
+    if (timer_due_ms_ != 0) {
+        loop_->cancelTimer(timer_id_);
+        timer_due_ms_ = 0;
+    }
+}
+
+uint64_t ConnTimeouts::nextDeadline() const {
+    uint64_t due = 0;
+    auto consider = [&due](uint64_t since, uint64_t timeout) {
+        if (timeout != 0 && since != 0) {
+            due = due == 0 ? since + timeout : std::min(due, since + timeout);
+        }
+    };
+    consider(last_active_ms_, idle_ms_);
+    consider(read_pending_since_, read_ms_);
+    consider(write_pending_since_, write_ms_);
+    return due;
+}
+
+// Only ever pulls the timer earlier; a later deadline is picked up when the
+// armed timer fires and re-checks.
+void ConnTimeouts::schedule(uint64_t due_ms) {
+    if (due_ms == 0 || (timer_due_ms_ != 0 && timer_due_ms_ <= due_ms)) {
+        return;
+    }
+    stop();
+    const uint64_t now = loop_->now();
+    timer_id_ = loop_->runAfter(due_ms > now ? due_ms - now : 0, &timerTrampoline, this);
+    timer_due_ms_ = due_ms;
+}
+
+void ConnTimeouts::handleTimer() {
+    timer_due_ms_ = 0;
+    const uint64_t now = loop_->now();
+
+    CloseReason reason;
+    if (write_ms_ && write_pending_since_ && now >= write_pending_since_ + write_ms_) {
+        reason = CloseReason::WriteTimeout;
+    } else if (read_ms_ && read_pending_since_ && now >= read_pending_since_ + read_ms_) {
+        reason = CloseReason::ReadTimeout;
+    } else if (idle_ms_ && now >= last_active_ms_ + idle_ms_) {
+        reason = CloseReason::IdleTimeout;
+    } else {
+        schedule(nextDeadline());
+        return;
+    }
+    expire_cb_(obj_, reason);
+}
+
+}  // namespace shnet
@@ -0,0 +1,60 @@
+#include <unistd.h>
+
+#include <cerrno>
+#include <system_error>
+
+#include "shlog/logger.h"
+#include "shnet/poller.h"
+
+namespace shnet {
+
+namespace {
+
+class EpollPoller final : public Poller {
+   public:
+    EpollPoller() {
+        epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            throw std::system_error(errno, std::system_category(), "epoll_create1 failed");
+        }
+    }
+
+    ~EpollPoller() override {
+        if (epfd_ != -1) {
+            ::close(epfd_);
+            epfd_ = -1;
+        }
+    }
+
+    int addEvent(int fd, uint32_t events, void* ptr) override {
+        return ctl(EPOLL_CTL_ADD, fd, events, ptr);
+    }
+
+    int modEvent(int fd, uint32_t events, void* ptr) override {
+        return ctl(EPOLL_CTL_MOD, fd, events, ptr);
+    }
+
+    int delEvent(int fd) override { return ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+    int poll(epoll_event* events, int max_events, int timeout_ms) override {
+        return ::epoll_wait(epfd_, events, max_events, timeout_ms);
+    }
+
+    PollerBackend backend() const override { return PollerBackend::Epoll; }
+
+   private:
+    int ctl(int op, int fd, uint32_t events, void* ptr) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = ptr;
+        return ::epoll_ctl(epfd_, op, fd, &ev);
+    }
+
+    int epfd_;
+};
+
+}  // namespace
+
+std::unique_ptr<Poller> newEpollPoller() { return std::make_unique<EpollPoller>(); }
+
+}  // namespace shnet
@@ -1,9 +1,13 @@
 #include "shnet/event_loop.h"
 
 #include <cerrno>
+#include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <chrono>
 #include <functional>
 #include <stdexcept>
 #include <system_error>
@@ -11,80 +15,277 @@
 #include "shnet/tcp_socket.h"
 
 namespace shnet {
-EventLoop::EventLoop() : running_{false} {
-    epfd_ = epoll_create1(0);
-    if (epfd_ < 0) {
-        throw std::system_error(errno, std::system_category(), "epoll_create1 failed");
+inline void EventLoop::wakeupTrampoline(void* obj, uint32_t) {
+    static_cast<EventLoop*>(obj)->handleWakeup();
+}
+
+EventLoop::EventLoop(PollerBackend backend)
+    : poller_(Poller::create(backend)),
+      running_{false},
+      thread_id_(std::this_thread::get_id()),
+      now_ms_(clockMs()),
+      timers_(now_ms_),
+      read_scratch_(std::make_unique_for_overwrite<char[]>(READ_SCRATCH_SIZE)) {
+    wakeup_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        throw std::system_error(errno, std::system_category(), "eventfd failed");
+    }
+
+    wakeup_handler_ = EventHandler{this, &wakeupTrampoline};
+    if (addEvent(wakeup_fd_, EPOLLIN, &wakeup_handler_) < 0) {
+        int err = errno;
+        ::close(wakeup_fd_);
+        throw std::system_error(err, std::system_category(),
+                                "failed to register wakeup fd to poller");
     }
 }
 
 EventLoop::~EventLoop() {
     stop();
-    if (epfd_ != -1) {
-        ::close(epfd_);
-        epfd_ = -1;
+    if (wakeup_fd_ != -1) {
+        ::close(wakeup_fd_);
+        wakeup_fd_ = -1;
     }
 }
 
+// The interest table is only touched on the loop thread; registrations from
+// other threads are not tracked.
 int EventLoop::addEvent(int fd, uint32_t events, void* ptr) {
-    epoll_event ev{};
-    ev.events = events;
-    ev.data.ptr = ptr;
-    int ret = ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+    assert(pollerAccessible());
+    int ret = poller_->addEvent(fd, events, ptr);
     if (ret < 0) [[unlikely]] {
-        SHLOG_ERROR("epoll_ctl ADD failed for fd {}: {}", fd, errno);
+        SHLOG_ERROR("poller add failed for fd {}: {}", fd, errno);
+        return ret;
+    }
+    if (isInLoopThread()) {
+        if (static_cast<size_t>(fd) >= interests_.size()) {
+            interests_.resize(std::max<size_t>(fd + 1, interests_.size() * 2));
+        }
+        const bool queued = interests_[fd].queued;
+        interests_[fd] = Interest{ptr, events, events, true, queued};
     }
     return ret;
 }
 
 int EventLoop::modEvent(int fd, uint32_t events, void* ptr) {
-    epoll_event ev{};
-    ev.events = events;
-    ev.data.ptr = ptr;
-    int ret = ::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+    assert(pollerAccessible());
+    int ret = poller_->modEvent(fd, events, ptr);
     if (ret < 0) [[unlikely]] {
-        SHLOG_ERROR("epoll_ctl MOD failed for fd {}: {}", fd, errno);
+        SHLOG_ERROR("poller mod failed for fd {}: {}", fd, errno);
+        return ret;
+    }
+    if (isInLoopThread() && static_cast<size_t>(fd) < interests_.size() &&
+        interests_[fd].tracked) {
+        interests_[fd].ptr = ptr;
+        interests_[fd].events = interests_[fd].wanted = events;
     }
     return ret;
 }
 
 int EventLoop::delEvent(int fd) {
-    int ret = ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+    assert(pollerAccessible());
+    int ret = poller_->delEvent(fd);
     if (ret < 0) [[unlikely]] {
-        SHLOG_ERROR("epoll_ctl DEL failed for fd {}: {}", fd, errno);
+        SHLOG_ERROR("poller del failed for fd {}: {}", fd, errno);
+    }
+    if (isInLoopThread() && static_cast<size_t>(fd) < interests_.size()) {
+        interests_[fd].tracked = false;
     }
     return ret;
 }
 
+void EventLoop::updateEvent(int fd, uint32_t events, void* ptr) {
+    if (static_cast<size_t>(fd) >= interests_.size() || !interests_[fd].tracked) [[unlikely]] {
+        modEvent(fd, events, ptr);
+        return;
+    }
+    Interest& interest = interests_[fd];
+    interest.ptr = ptr;
+    interest.wanted = events;
+    if (!interest.queued && events != interest.events) {
+        interest.queued = true;
+        updated_fds_.push_back(fd);
+    }
+}
+
+int EventLoop::acceptMultishot(int fd, CompletionHandler handler) {
+    assert(pollerAccessible());
+    return poller_->acceptMultishot(fd, handler);
+}
+
+int EventLoop::recvMultishot(int fd, CompletionHandler handler) {
+    assert(pollerAccessible());
+    return poller_->recvMultishot(fd, handler);
+}
+
+int EventLoop::sendMsg(int fd, const msghdr* msg, CompletionHandler handler) {
+    assert(pollerAccessible());
+    return poller_->sendMsg(fd, msg, handler);
+}
+
+void EventLoop::cancelOp(int op) {
+    assert(pollerAccessible());
+    poller_->cancelOp(op);
+}
+
+void EventLoop::detachOp(int op) {
+    assert(pollerAccessible());
+    poller_->detachOp(op);
+}
+
+void EventLoop::waitOp(int op) {
+    assert(pollerAccessible());
+    poller_->waitOp(op);
+}
+
+void EventLoop::flushEventUpdates() {
+    for (int fd : updated_fds_) {
+        Interest& interest = interests_[fd];
+        interest.queued = false;
+        // Set back in the meantime, or the fd was removed.
+        if (!interest.tracked || interest.wanted == interest.events) {
+            continue;
+        }
+        if (poller_->modEvent(fd, interest.wanted, interest.ptr) < 0) [[unlikely]] {
+            SHLOG_ERROR("poller mod failed for fd {}: {}", fd, errno);
+            continue;
+        }
+        interest.events = interest.wanted;
+    }
+    updated_fds_.clear();
+}
+
 void EventLoop::run() {
     running_ = true;
 
-    static std::array<epoll_event, MAX_EVENTS> events;
-
     while (running_) {
-        int nfds = epoll_wait(epfd_, events.data(), MAX_EVENTS, 100);
+        flushEventUpdates();
+        int nfds = poller_->poll(events_.data(), MAX_EVENTS, pollTimeout());
+        now_ms_ = clockMs();
 
         if (nfds == -1) [[unlikely]] {
             if (errno == EINTR) [[likely]] {
                 continue;
             }
-            SHLOG_ERROR("epoll_wait failed with: {}", errno);
+            SHLOG_ERROR("poll failed with: {}", errno);
             continue;
         }
 
         for (int i = 0; i < nfds; ++i) {
-            auto handler = static_cast<EventHandler*>(events[i].data.ptr);
+            auto handler = static_cast<EventHandler*>(events_[i].data.ptr);
             if (handler == nullptr) [[unlikely]] {
-                SHLOG_ERROR("epoll event handler missing");
+                SHLOG_ERROR("event handler missing");
                 continue;
             }
-            (*handler)(events[i].events);
+            (*handler)(events_[i].events);
         }
-        
+        poller_->dispatchCompletions();
+
+        runDeferred();
+        doPendingFunctors();
         coro_scheduler_.run_once();
-        Timer::GetInst().run_once();
+        timers_.advance(now_ms_);
+    }
+
+    // Sends in flight point into connection buffers and keep their
+    // connections alive until they complete.
+    poller_->drainOps();
+
+    // Drop what was queued but never ran while still on the loop thread:
+    // functors may hold connections that must not outlive their owners.
+    while (!pending_functors_.empty()) {
+        pending_functors_.drain([](Functor&) {});
+    }
+}
+
+uint64_t EventLoop::clockMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+int EventLoop::pollTimeout() const {
+    if (!pending_functors_.empty() || !deferred_.empty()) {
+        return 0;
+    }
+    int64_t timeout = timers_.nextTimeout(clockMs());
+    if (timeout < 0 || timeout > MAX_POLL_TIMEOUT_MS) {
+        return MAX_POLL_TIMEOUT_MS;
+    }
+    return static_cast<int>(timeout);
+}
+
+EventLoop::TimerId EventLoop::runAfter(uint64_t delay_ms, TimerCallback cb, void* obj) {
+    return timers_.add(clockMs(), delay_ms, cb, obj);
+}
+
+void EventLoop::stop() {
+    running_ = false;
+    if (!isInLoopThread()) {
+        wakeup();
+    }
+}
+
+void EventLoop::runInLoop(Functor cb) {
+    if (isInLoopThread()) {
+        cb();
+    } else {
+        queueInLoop(std::move(cb));
+    }
+}
+
+void EventLoop::queueInLoop(Functor cb) {
+    pending_functors_.push(std::move(cb));
+    // Functors queued while draining run in the next round; make sure that
+    // round does not sit in the poller wait.
+    if (!isInLoopThread() || calling_pending_) {
+        if (!wakeup_pending_.exchange(true)) {
+            wakeup();
+        }
+    }
+}
+
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    if (::write(wakeup_fd_, &one, sizeof(one)) != sizeof(one)) [[unlikely]] {
+        SHLOG_ERROR("wakeup write failed on fd {}: {}", wakeup_fd_, errno);
+    }
+}
+
+void EventLoop::handleWakeup() {
+    uint64_t cnt = 0;
+    if (::read(wakeup_fd_, &cnt, sizeof(cnt)) != sizeof(cnt)) [[unlikely]] {
+        if (errno != EAGAIN) {
+            SHLOG_ERROR("wakeup read failed on fd {}: {}", wakeup_fd_, errno);
+        }
     }
 }
 
-void EventLoop::stop() { running_ = false; }
+void EventLoop::runDeferred() {
+    if (deferred_.empty()) {
+        return;
+    }
+    // Both vectors keep their capacity, so steady deferring doesn't allocate
+    // beyond the functors themselves.
+    running_deferred_.swap(deferred_);
+    for (Functor& cb : running_deferred_) {
+        cb();
+    }
+    running_deferred_.clear();
+}
+
+void EventLoop::doPendingFunctors() {
+    // Producers that push after this point post a fresh wakeup. Clearing
+    // before the drain means the flag is only ever left set while an eventfd
+    // write is still in flight.
+    if (wakeup_pending_.load(std::memory_order_relaxed)) {
+        wakeup_pending_.exchange(false);
+    }
+    if (pending_functors_.empty()) {
+        return;
+    }
+
+    calling_pending_ = true;
+    pending_functors_.drain([](Functor& cb) { cb(); });
+    calling_pending_ = false;
+}
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "shnet/event_loop_thread_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <latch>
+
+namespace shnet {
+
+EventLoopThreadPool::EventLoopThreadPool(EventLoop* base_loop, size_t num_threads)
+    : base_loop_(base_loop), num_threads_(num_threads) {}
+
+EventLoopThreadPool::~EventLoopThreadPool() { stop(); }
+
+void EventLoopThreadPool::start() {
+    if (started_) [[unlikely]] {
+        return;
+    }
+    started_ = true;
+
+    owned_loops_.resize(num_threads_);
+    const size_t num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    std::latch ready(static_cast<std::ptrdiff_t>(num_threads_));
+    for (size_t i = 0; i < num_threads_; ++i) {
+        threads_.emplace_back([this, i, num_cpus, &ready] {
+            if (cpu_affinity_) {
+                cpu_set_t cpus;
+                CPU_ZERO(&cpus);
+                CPU_SET(i % num_cpus, &cpus);
+                int err = ::pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+                if (err != 0) [[unlikely]] {
+                    SHLOG_ERROR("failed to pin loop thread {} to cpu {}: {}", i,
+                                i % num_cpus, err);
+                }
+            }
+            // The loop must be constructed on the thread that runs it.
+            owned_loops_[i] = std::make_unique<EventLoop>(base_loop_->backend());
+            EventLoop* loop = owned_loops_[i].get();
+            ready.count_down();
+            loop->run();
+        });
+    }
+    ready.wait();
+
+    for (auto& loop : owned_loops_) {
+        loops_.push_back(loop.get());
+    }
+    SHLOG_INFO("EventLoopThreadPool started with {} threads", num_threads_);
+}
+
+void EventLoopThreadPool::stop() {
+    for (auto* loop : loops_) {
+        loop->stop();
+    }
+    for (auto& t : threads_) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+    threads_.clear();
+}
+
+EventLoop* EventLoopThreadPool::getNextLoop() {
+    if (loops_.empty()) {
+        return base_loop_;
+    }
+    EventLoop* loop = loops_[next_];
+    next_ = (next_ + 1) % loops_.size();
+    return loop;
+}
+
+EventLoop* EventLoopThreadPool::getLoopForHash(size_t hash) {
+    if (loops_.empty()) {
+        return base_loop_;
+    }
+    return loops_[hash % loops_.size()];
+}
+
+}  // namespace shnet
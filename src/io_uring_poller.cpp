@@ -0,0 +1,695 @@
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <vector>
+
+#include "shlog/logger.h"
+#include "shnet/poller.h"
+
+namespace shnet {
+
+namespace {
+
+int ioUringSetup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                 void* arg, size_t argsz) {
+    return static_cast<int>(
+        ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template <typename T>
+T* ringPtr(void* base, uint32_t off) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+}
+
+// io_uring backend.
+//
+// Readiness: every interest change is queued as an SQE and submitted together
+// with the wait in a single io_uring_enter(), so add/mod/del cost no syscall
+// of their own. Level-triggered interest is emulated with one-shot polls that
+// are re-armed (again batched) after their completion was dispatched: arming
+// a poll checks current readiness, which gives epoll LT semantics. EPOLLET
+// interest uses a multishot poll instead.
+//
+// Operations: listen fds get a multishot accept, connections a multishot
+// receive into a ring of provided buffers, and sends are SENDMSG SQEs. All of
+// them are submitted with the next wait, so a loop round costs one
+// io_uring_enter() however many connections it accepted, read or wrote.
+//
+// user_data of a poll carries (generation << 32 | fd) so completions that
+// belong to a registration removed or replaced in the meantime are dropped
+// instead of dispatched to a stale handler. Operations set the top bit and
+// carry the index of their slot in ops_ instead.
+//
+// Registrations and the SQ ring are unsynchronized, so only the loop thread
+// may call in while it runs.
+class IoUringPoller final : public Poller {
+   public:
+    static std::unique_ptr<Poller> create() {
+        std::unique_ptr<IoUringPoller> poller(new IoUringPoller());
+        if (!poller->init()) {
+            return nullptr;
+        }
+        return poller;
+    }
+
+    ~IoUringPoller() override {
+        if (ring_ != MAP_FAILED) {
+            // Connections accepted for nobody anymore.
+            reapAll();
+            for (const Done& done : completed_) {
+                if (done.op != NO_OP && ops_[done.op].kind == OpKind::Accept && done.res >= 0) {
+                    ::close(done.res);
+                }
+            }
+        }
+        if (buf_ring_ != MAP_FAILED) {
+            ::munmap(buf_ring_, BUF_RING_SIZE);
+        }
+        if (sqes_ != MAP_FAILED) {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (ring_ != MAP_FAILED) {
+            ::munmap(ring_, ring_size_);
+        }
+        if (ring_fd_ != -1) {
+            ::close(ring_fd_);
+        }
+    }
+
+    int addEvent(int fd, uint32_t events, void* ptr) override {
+        if (fd < 0) [[unlikely]] {
+            errno = EBADF;
+            return -1;
+        }
+        if (static_cast<size_t>(fd) >= regs_.size()) {
+            regs_.resize(static_cast<size_t>(fd) + 1);
+        }
+        Registration& reg = regs_[fd];
+        if (reg.ptr != nullptr) [[unlikely]] {
+            errno = EEXIST;
+            return -1;
+        }
+        reg.ptr = ptr;
+        reg.events = events;
+        return arm(fd, reg);
+    }
+
+    int modEvent(int fd, uint32_t events, void* ptr) override {
+        Registration* reg = lookup(fd);
+        if (reg == nullptr) [[unlikely]] {
+            errno = ENOENT;
+            return -1;
+        }
+        if (reg->events == events && reg->ptr == ptr) {
+            return 0;
+        }
+        cancel(fd, *reg);
+        reg->ptr = ptr;
+        reg->events = events;
+        return arm(fd, *reg);
+    }
+
+    int delEvent(int fd) override {
+        Registration* reg = lookup(fd);
+        if (reg == nullptr) [[unlikely]] {
+            errno = ENOENT;
+            return -1;
+        }
+        cancel(fd, *reg);
+        reg->ptr = nullptr;
+        return 0;
+    }
+
+    int poll(epoll_event* events, int max_events, int timeout_ms) override {
+        for (int fd : rearm_) {
+            Registration* reg = lookup(fd);
+            if (reg != nullptr && !reg->armed) {
+                arm(fd, *reg);
+            }
+        }
+        rearm_.clear();
+
+        unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        const bool ready = cqReady() > 0 || !stashed_.empty() || !completed_.empty();
+        int ret = ioUringEnter(ring_fd_, pendingSubmit(), ready ? 0 : 1, flags, &arg,
+                               sizeof(arg));
+        if (ret < 0 && errno != ETIME && errno != EBUSY) {
+            return -1;
+        }
+        // Polls waitOp() reaped come first.
+        int n = 0;
+        size_t i = 0;
+        for (; i < stashed_.size() && n < max_events; ++i) {
+            n += translate(stashed_[i], events[n]);
+        }
+        stashed_.erase(stashed_.begin(), stashed_.begin() + static_cast<ptrdiff_t>(i));
+        return reap(events, max_events, n);
+    }
+
+    PollerBackend backend() const override { return PollerBackend::IoUring; }
+
+    bool asyncIo() const override { return buf_ring_ != MAP_FAILED; }
+
+    int acceptMultishot(int fd, CompletionHandler handler) override {
+        int op;
+        io_uring_sqe* sqe = prepareOp(OpKind::Accept, handler, &op);
+        if (sqe == nullptr) [[unlikely]] {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        commitSqe();
+        return op;
+    }
+
+    int recvMultishot(int fd, CompletionHandler handler) override {
+        if (!bufs_ && asyncIo()) {
+            provideBuffers();
+        }
+        int op;
+        io_uring_sqe* sqe = prepareOp(OpKind::Recv, handler, &op);
+        if (sqe == nullptr) [[unlikely]] {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        commitSqe();
+        return op;
+    }
+
+    int sendMsg(int fd, const msghdr* msg, CompletionHandler handler) override {
+        if (draining_) [[unlikely]] {
+            errno = ECANCELED;
+            return -1;
+        }
+        int op;
+        io_uring_sqe* sqe = prepareOp(OpKind::Send, handler, &op);
+        if (sqe == nullptr) [[unlikely]] {
+            return -1;
+        }
+        sqe->fd = fd;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        if (msg->msg_iovlen == 1 && msg->msg_name == nullptr && msg->msg_controllen == 0) {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = reinterpret_cast<uint64_t>(msg->msg_iov[0].iov_base);
+            sqe->len = static_cast<uint32_t>(msg->msg_iov[0].iov_len);
+        } else {
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = reinterpret_cast<uint64_t>(msg);
+            sqe->len = 1;
+        }
+        ++sends_in_flight_;
+        commitSqe();
+        return op;
+    }
+
+    void cancelOp(int op) override {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr) [[unlikely]] {
+            SHLOG_ERROR("failed to cancel io_uring operation {}: {}", op, errno);
+            return;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = OP_TAG | static_cast<uint32_t>(op);
+        sqe->user_data = IGNORE_TAG;
+        commitSqe();
+        // Submitted right away: a cancelled operation still holds its file,
+        // and a closed socket would only go away with the next wait.
+        if (ioUringEnter(ring_fd_, pendingSubmit(), 0, 0, nullptr, 0) < 0) [[unlikely]] {
+            SHLOG_ERROR("io_uring submit failed: {}", errno);
+        }
+    }
+
+    void detachOp(int op) override {
+        ops_[op].handler.cb = nullptr;
+        cancelOp(op);
+    }
+
+    void waitOp(int op) override {
+        const uint32_t seq = ops_[op].seq;
+        while (ops_[op].seq == seq) {
+            for (size_t i = 0; i < completed_.size() && ops_[op].seq == seq; ++i) {
+                if (completed_[i].op == static_cast<uint32_t>(op)) {
+                    const Done done = completed_[i];
+                    completed_[i].op = NO_OP;
+                    complete(done);
+                }
+            }
+            if (ops_[op].seq != seq) {
+                break;
+            }
+            if (ioUringEnter(ring_fd_, pendingSubmit(), 1, IORING_ENTER_GETEVENTS, nullptr, 0) <
+                    0 &&
+                errno != EINTR) [[unlikely]] {
+                SHLOG_ERROR("io_uring wait failed: {}", errno);
+                return;
+            }
+            reapAll();
+        }
+    }
+
+    void dispatchCompletions() override {
+        // Handlers may add entries through waitOp(), and consume some.
+        for (size_t i = 0; i < completed_.size(); ++i) {
+            if (completed_[i].op != NO_OP) {
+                const Done done = completed_[i];
+                completed_[i].op = NO_OP;
+                complete(done);
+            }
+        }
+        completed_.clear();
+    }
+
+    void drainOps() override {
+        for (size_t i = 0; i < ops_.size(); ++i) {
+            if (ops_[i].in_use && ops_[i].kind == OpKind::Send) {
+                cancelOp(static_cast<int>(i));
+            }
+        }
+        // Other completions are left for the next run.
+        draining_ = true;
+        while (sends_in_flight_ > 0) {
+            for (size_t i = 0; i < completed_.size(); ++i) {
+                if (completed_[i].op != NO_OP && ops_[completed_[i].op].kind == OpKind::Send) {
+                    const Done done = completed_[i];
+                    completed_[i].op = NO_OP;
+                    complete(done);
+                }
+            }
+            if (sends_in_flight_ == 0) {
+                break;
+            }
+            if (ioUringEnter(ring_fd_, pendingSubmit(), 1, IORING_ENTER_GETEVENTS, nullptr, 0) <
+                    0 &&
+                errno != EINTR) [[unlikely]] {
+                SHLOG_ERROR("io_uring wait failed: {}", errno);
+                break;
+            }
+            reapAll();
+        }
+        draining_ = false;
+    }
+
+   private:
+    struct Registration {
+        void* ptr{nullptr};
+        uint32_t events{0};
+        uint32_t gen{0};
+        bool armed{false};
+    };
+
+    enum class OpKind : uint8_t {
+        Accept,
+        Recv,
+        Send,
+    };
+
+    struct Op {
+        CompletionHandler handler{nullptr, nullptr};  // no cb: detached
+        uint32_t seq{0};  // bumped when the slot is freed, see waitOp()
+        uint32_t next_free{NO_OP};
+        OpKind kind{OpKind::Send};
+        bool in_use{false};
+    };
+
+    // An operation completion that wasn't handed to its handler yet.
+    struct Done {
+        uint32_t op;
+        int32_t res;
+        uint32_t flags;
+    };
+
+    // Completions of cancel requests.
+    static constexpr uint64_t IGNORE_TAG = ~0ull;
+    static constexpr uint64_t OP_TAG = 1ull << 63;
+    static constexpr uint32_t NO_OP = ~0u;
+    static constexpr unsigned RING_ENTRIES = 1 << 10;
+    // Provided receive buffers, shared by the connections of the loop. A
+    // buffer goes back to the ring as soon as its completion was handled.
+    static constexpr unsigned BUF_COUNT = 256;
+    static constexpr size_t BUF_SIZE = 16 * 1024;
+    static constexpr uint16_t BUF_GROUP = 0;
+    static constexpr size_t BUF_RING_SIZE = BUF_COUNT * sizeof(io_uring_buf);
+
+    static uint64_t tag(int fd, uint32_t gen) {
+        return (static_cast<uint64_t>(gen & 0x7fffffffu) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    IoUringPoller() = default;
+
+    bool init() {
+        io_uring_params params{};
+        params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+        ring_fd_ = ioUringSetup(RING_ENTRIES, &params);
+        if (ring_fd_ < 0 && errno == EINVAL) {
+            // Older kernel; the flags are only optimisations.
+            params = io_uring_params{};
+            ring_fd_ = ioUringSetup(RING_ENTRIES, &params);
+        }
+        if (ring_fd_ < 0) {
+            SHLOG_WARN("io_uring_setup failed: {}", errno);
+            return false;
+        }
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP) ||
+            !(params.features & IORING_FEAT_EXT_ARG)) {
+            SHLOG_WARN("io_uring lacks SINGLE_MMAP/EXT_ARG, features: {}", params.features);
+            return false;
+        }
+
+        const io_sqring_offsets& so = params.sq_off;
+        const io_cqring_offsets& co = params.cq_off;
+        size_t sq_size = so.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_size = co.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring_size_ = std::max(sq_size, cq_size);
+        ring_ = ::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQ_RING);
+        if (ring_ == MAP_FAILED) {
+            SHLOG_WARN("io_uring ring mmap failed: {}", errno);
+            return false;
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) {
+            SHLOG_WARN("io_uring sqe mmap failed: {}", errno);
+            return false;
+        }
+
+        sq_head_ = ringPtr<unsigned>(ring_, so.head);
+        sq_tail_ = ringPtr<unsigned>(ring_, so.tail);
+        sq_mask_ = *ringPtr<unsigned>(ring_, so.ring_mask);
+        sq_entries_ = *ringPtr<unsigned>(ring_, so.ring_entries);
+        sq_array_ = ringPtr<unsigned>(ring_, so.array);
+        cq_head_ = ringPtr<unsigned>(ring_, co.head);
+        cq_tail_ = ringPtr<unsigned>(ring_, co.tail);
+        cq_mask_ = *ringPtr<unsigned>(ring_, co.ring_mask);
+        cqes_ = ringPtr<io_uring_cqe>(ring_, co.cqes);
+        sq_local_tail_ = *sq_tail_;
+        registerBufRing();
+        return true;
+    }
+
+    // Kernels before 5.19 lack provided buffer rings, and with them multishot
+    // accept; the backend then only does readiness.
+    void registerBufRing() {
+        void* ring = ::mmap(nullptr, BUF_RING_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ring == MAP_FAILED) {
+            SHLOG_WARN("io_uring buffer ring mmap failed: {}", errno);
+            return;
+        }
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+        reg.ring_entries = BUF_COUNT;
+        reg.bgid = BUF_GROUP;
+        if (ioUringRegister(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            SHLOG_WARN("io_uring buffer ring unavailable, readiness only: {}", errno);
+            ::munmap(ring, BUF_RING_SIZE);
+            return;
+        }
+        buf_ring_ = ring;
+    }
+
+    // The buffers themselves are only allocated once a receive needs them.
+    void provideBuffers() {
+        bufs_ = std::make_unique_for_overwrite<char[]>(BUF_COUNT * BUF_SIZE);
+        for (unsigned bid = 0; bid < BUF_COUNT; ++bid) {
+            recycleBuffer(static_cast<uint16_t>(bid));
+        }
+    }
+
+    void recycleBuffer(uint16_t bid) {
+        // Not ring->bufs: in C++ the header's flexible array member sits
+        // behind an empty struct, which takes a byte there.
+        auto* ring = static_cast<io_uring_buf_ring*>(buf_ring_);
+        io_uring_buf& buf = static_cast<io_uring_buf*>(buf_ring_)[buf_tail_ & (BUF_COUNT - 1)];
+        buf.addr = reinterpret_cast<uint64_t>(bufs_.get() + bid * BUF_SIZE);
+        buf.len = BUF_SIZE;
+        buf.bid = bid;
+        ++buf_tail_;
+        __atomic_store_n(&ring->tail, buf_tail_, __ATOMIC_RELEASE);
+    }
+
+    io_uring_sqe* prepareOp(OpKind kind, CompletionHandler handler, int* id) {
+        if (buf_ring_ == MAP_FAILED) [[unlikely]] {
+            errno = ENOTSUP;
+            return nullptr;
+        }
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr) [[unlikely]] {
+            return nullptr;
+        }
+        uint32_t idx = free_op_;
+        if (idx == NO_OP) {
+            idx = static_cast<uint32_t>(ops_.size());
+            ops_.emplace_back();
+        } else {
+            free_op_ = ops_[idx].next_free;
+        }
+        Op& op = ops_[idx];
+        op.handler = handler;
+        op.kind = kind;
+        op.in_use = true;
+        sqe->user_data = OP_TAG | idx;
+        *id = static_cast<int>(idx);
+        return sqe;
+    }
+
+    void freeOp(uint32_t idx) {
+        Op& op = ops_[idx];
+        if (op.kind == OpKind::Send) {
+            --sends_in_flight_;
+        }
+        op.in_use = false;
+        ++op.seq;
+        op.next_free = free_op_;
+        free_op_ = idx;
+    }
+
+    void complete(const Done& done) {
+        Op& op = ops_[done.op];
+        const bool more = done.flags & IORING_CQE_F_MORE;
+        const char* data = nullptr;
+        int bid = -1;
+        if (done.flags & IORING_CQE_F_BUFFER) {
+            bid = static_cast<int>(done.flags >> IORING_CQE_BUFFER_SHIFT);
+            data = bufs_.get() + static_cast<size_t>(bid) * BUF_SIZE;
+        }
+        const CompletionHandler handler = op.handler;
+        const OpKind kind = op.kind;
+        // Freed first: the handler may start the next operation right away.
+        if (!more) {
+            freeOp(done.op);
+        }
+        if (handler.cb != nullptr) {
+            handler(Completion{done.res, more, data});
+        } else if (kind == OpKind::Accept && done.res >= 0) {
+            ::close(done.res);
+        }
+        if (bid >= 0) {
+            recycleBuffer(static_cast<uint16_t>(bid));
+        }
+    }
+
+    Registration* lookup(int fd) {
+        if (fd < 0 || static_cast<size_t>(fd) >= regs_.size()) [[unlikely]] {
+            return nullptr;
+        }
+        Registration& reg = regs_[fd];
+        return reg.ptr != nullptr ? &reg : nullptr;
+    }
+
+    unsigned cqReady() const {
+        return __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+    }
+
+    unsigned pendingSubmit() const {
+        return sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    }
+
+    io_uring_sqe* getSqe() {
+        if (pendingSubmit() >= sq_entries_) [[unlikely]] {
+            // Ring is full of queued changes; flush them without waiting.
+            if (ioUringEnter(ring_fd_, pendingSubmit(), 0, 0, nullptr, 0) < 0) {
+                SHLOG_ERROR("io_uring submit failed: {}", errno);
+                return nullptr;
+            }
+            if (pendingSubmit() >= sq_entries_) {
+                errno = EBUSY;
+                return nullptr;
+            }
+        }
+        const unsigned idx = sq_local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes_) + idx;
+        *sqe = io_uring_sqe{};
+        sq_array_[idx] = idx;
+        return sqe;
+    }
+
+    void commitSqe() {
+        ++sq_local_tail_;
+        __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    }
+
+    int arm(int fd, Registration& reg) {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr) [[unlikely]] {
+            return -1;
+        }
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = reg.events & ~(EPOLLET | EPOLLONESHOT);
+        if (reg.events & EPOLLET) {
+            sqe->len = IORING_POLL_ADD_MULTI;
+        }
+        sqe->user_data = tag(fd, reg.gen);
+        commitSqe();
+        reg.armed = true;
+        return 0;
+    }
+
+    void cancel(int fd, Registration& reg) {
+        if (reg.armed) {
+            io_uring_sqe* sqe = getSqe();
+            if (sqe != nullptr) [[likely]] {
+                sqe->opcode = IORING_OP_POLL_REMOVE;
+                sqe->fd = -1;
+                sqe->addr = tag(fd, reg.gen);
+                sqe->user_data = IGNORE_TAG;
+                commitSqe();
+            }
+            reg.armed = false;
+        }
+        // Whatever the old poll still completes with is stale from now on.
+        ++reg.gen;
+    }
+
+    // Readiness completions go to events, up to max_events of them, and
+    // operation ones to completed_.
+    int reap(epoll_event* events, int max_events, int n) {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != tail && n < max_events) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            ++head;
+            if (cqe.user_data == IGNORE_TAG) {
+                continue;
+            }
+            if (cqe.user_data & OP_TAG) {
+                completed_.push_back(doneOf(cqe));
+                continue;
+            }
+            n += translate(cqe, events[n]);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    // Empties the CQ ring; readiness completions wait in stashed_ for poll().
+    void reapAll() {
+        unsigned head = *cq_head_;
+        const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            if (cqe.user_data == IGNORE_TAG) {
+                continue;
+            }
+            if (cqe.user_data & OP_TAG) {
+                completed_.push_back(doneOf(cqe));
+            } else {
+                stashed_.push_back(cqe);
+            }
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+    static Done doneOf(const io_uring_cqe& cqe) {
+        return Done{static_cast<uint32_t>(cqe.user_data), cqe.res, cqe.flags};
+    }
+
+    // Fills ev from a poll completion; returns 0 when there is nothing to
+    // report.
+    int translate(const io_uring_cqe& cqe, epoll_event& ev) {
+        const int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        const uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32);
+        Registration* reg = lookup(fd);
+        if (reg == nullptr || (reg->gen & 0x7fffffffu) != gen) {
+            return 0;
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            reg->armed = false;
+            rearm_.push_back(fd);
+        }
+        if (cqe.res == -ECANCELED) {
+            return 0;
+        }
+        ev.events = cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+        ev.data.ptr = reg->ptr;
+        return 1;
+    }
+
+    int ring_fd_{-1};
+    void* ring_{MAP_FAILED};
+    size_t ring_size_{0};
+    void* sqes_{MAP_FAILED};
+    size_t sqes_size_{0};
+
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned* sq_array_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned sq_entries_{0};
+    unsigned sq_local_tail_{0};
+
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+
+    std::vector<Registration> regs_;
+    std::vector<int> rearm_;
+    std::vector<io_uring_cqe> stashed_;
+
+    std::vector<Op> ops_;
+    uint32_t free_op_{NO_OP};
+    std::vector<Done> completed_;
+    size_t sends_in_flight_{0};
+    bool draining_{false};
+
+    void* buf_ring_{MAP_FAILED};
+    uint16_t buf_tail_{0};
+    std::unique_ptr<char[]> bufs_;
+};
+
+}  // namespace
+
+std::unique_ptr<Poller> newIoUringPoller() { return IoUringPoller::create(); }
+
+}  // namespace shnet
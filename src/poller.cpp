@@ -0,0 +1,24 @@
+#include "shnet/poller.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include "shlog/logger.h"
+
+namespace shnet {
+
+std::unique_ptr<Poller> newEpollPoller();
+std::unique_ptr<Poller> newIoUringPoller();
+
+std::unique_ptr<Poller> Poller::create(PollerBackend backend) {
+    if (backend == PollerBackend::IoUring) {
+        auto poller = newIoUringPoller();
+        if (poller) {
+            return poller;
+        }
+        SHLOG_WARN("io_uring backend unavailable, falling back to epoll");
+    }
+    return newEpollPoller();
+}
+
+}  // namespace shnet
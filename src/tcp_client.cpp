@@ -1,12 +1,15 @@
 #include "shnet/tcp_client.h"
 
 #include <arpa/inet.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <array>
 #include <cerrno>
 #include <system_error>
+#include <vector>
 
 #include "shcoro/stackless/utility.hpp"
 #include "shnet/event_loop.h"
@@ -17,8 +20,16 @@ inline void TcpClient::ioTrampoline(void* obj, uint32_t events) {
     static_cast<TcpClient*>(obj)->handleIO(events);
 }
 
+inline void TcpClient::timeoutTrampoline(void* obj, CloseReason reason) {
+    static_cast<TcpClient*>(obj)->close(reason);
+}
+
 TcpClient::TcpClient(EventLoop* loop)
-    : ev_loop_(loop), conn_sk_([] {
+    : ev_loop_(loop),
+      timeouts_(loop, this, &timeoutTrampoline),
+      rcv_buf_(&loop->messageBufferPool(), RCV_BUF_SIZE),
+      snd_buf_(&loop->blockPool(), SOCK_SEND_LEN),
+      conn_sk_([] {
           int fd = ::socket(AF_INET, SOCK_STREAM, 0);
           if (fd == -1) [[unlikely]] {
               throw std::system_error(errno, std::system_category(),
@@ -29,6 +40,14 @@ TcpClient::TcpClient(EventLoop* loop)
 
 TcpClient::~TcpClient() { close(); }
 
+uint32_t TcpClient::ioEvents(bool want_write) const {
+    const uint32_t in = read_paused_ ? 0u : static_cast<uint32_t>(EPOLLIN);
+    if (edge_triggered_) {
+        return in | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    }
+    return want_write ? in | EPOLLOUT : in;
+}
+
 int TcpClient::connect(const std::string& ip, uint16_t port) {
     if (closed_) [[unlikely]] {
         return -ESHUTDOWN;
@@ -46,39 +65,81 @@ int TcpClient::connect(const std::string& ip, uint16_t port) {
     conn_sk_.setNonBlocking();
     conn_sk_.setKeepAlive();
 
+    int ret = connectTo(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if (ret == 0) {
+        SHLOG_INFO("TcpClient {} to {}:{}",
+                   connect_in_progress_ ? "connecting asynchronously" : "connected immediately",
+                   ip, port);
+    }
+    return ret;
+}
+
+int TcpClient::connectUnix(const std::string& path) {
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+    UnixAddress addr(path);
+    int ret = openUnixSocket(addr);
+    if (ret < 0) {
+        return ret;
+    }
+    conn_sk_.setNonBlocking();
+
+    ret = connectTo(addr.sockAddr(), addr.length());
+    if (ret == 0) {
+        SHLOG_INFO("TcpClient {} to unix socket {}",
+                   connect_in_progress_ ? "connecting asynchronously" : "connected immediately",
+                   path);
+    }
+    return ret;
+}
+
+int TcpClient::openUnixSocket(const UnixAddress& addr) {
+    if (connected_ || connect_in_progress_) [[unlikely]] {
+        return -EISCONN;
+    }
+    if (!addr.valid()) {
+        SHLOG_ERROR("invalid unix socket path for connector fd {}", conn_sk_.fd());
+        return -EINVAL;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) [[unlikely]] {
+        SHLOG_ERROR("fail to create unix connector fd: {}", errno);
+        return -errno;
+    }
+    conn_sk_.reset(fd);
+    return 0;
+}
+
+int TcpClient::connectTo(const sockaddr* addr, socklen_t len) {
     const int fd = conn_sk_.fd();
 
-    int ret = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int ret = ::connect(fd, addr, len);
     if (ret == 0) {
         connected_ = true;
         io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
-        if (ev_loop_->addEvent(fd, EPOLLIN, &io_handler_) < 0) [[unlikely]] {
+        if (ev_loop_->addEvent(fd, ioEvents(false), &io_handler_) < 0) [[unlikely]] {
             SHLOG_ERROR("failed to register connector fd {} to epoll: {}", fd, errno);
-            close();
+            close(CloseReason::Error);
             return -errno;
         }
-        SHLOG_INFO("TcpClient connected immediately to {}:{}", ip, port);
         return 0;
     }
 
-    if (ret < 0) {
-        int err = errno;
-        if (err != EINPROGRESS) {
-            SHLOG_ERROR("connect failed immediately for fd {}: {}", fd, err);
-            return -err;
-        }
-
-        // Non-blocking connect in progress; wait for EPOLLOUT to finish it.
-        connect_in_progress_ = true;
-        io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
-        if (ev_loop_->addEvent(fd, EPOLLIN | EPOLLOUT, &io_handler_) < 0) [[unlikely]] {
-            SHLOG_ERROR("failed to register connector fd {} to epoll: {}", fd, errno);
-            close();
-            return -errno;
-        }
-        SHLOG_INFO("TcpClient connecting asynchronously to {}:{}", ip, port);
+    int err = errno;
+    if (err != EINPROGRESS) {
+        SHLOG_ERROR("connect failed immediately for fd {}: {}", fd, err);
+        return -err;
     }
 
+    // Non-blocking connect in progress; wait for EPOLLOUT to finish it.
+    connect_in_progress_ = true;
+    io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
+    if (ev_loop_->addEvent(fd, ioEvents(true), &io_handler_) < 0) [[unlikely]] {
+        SHLOG_ERROR("failed to register connector fd {} to epoll: {}", fd, errno);
+        close(CloseReason::Error);
+        return -errno;
+    }
     return 0;
 }
 
@@ -96,11 +157,37 @@ int TcpClient::connectBlocking(const std::string& ip, uint16_t port) {
         return -EINVAL;
     }
 
+    conn_sk_.setKeepAlive();
+    int ret = connectBlockingTo(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if (ret == 0) {
+        SHLOG_INFO("TcpClient blocking connected to {}:{}", ip, port);
+    }
+    return ret;
+}
+
+int TcpClient::connectUnixBlocking(const std::string& path) {
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+    UnixAddress addr(path);
+    int ret = openUnixSocket(addr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = connectBlockingTo(addr.sockAddr(), addr.length());
+    if (ret == 0) {
+        SHLOG_INFO("TcpClient blocking connected to unix socket {}", path);
+    }
+    return ret;
+}
+
+int TcpClient::connectBlockingTo(const sockaddr* addr, socklen_t len) {
     // Ensure we are in blocking mode for a truly blocking connect().
     conn_sk_.setBlocking();
     const int fd = conn_sk_.fd();
 
-    int ret = ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    int ret = ::connect(fd, addr, len);
 
     if (ret < 0) [[unlikely]] {
         int err = errno;
@@ -111,32 +198,31 @@ int TcpClient::connectBlocking(const std::string& ip, uint16_t port) {
     // Connection established synchronously; switch back to non-blocking and
     // integrate with EventLoop exactly like an immediate success in connect().
     conn_sk_.setNonBlocking();
-    conn_sk_.setKeepAlive();
 
     connected_ = true;
     io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
-    if (ev_loop_->addEvent(fd, EPOLLIN, &io_handler_) < 0) [[unlikely]] {
+    if (ev_loop_->addEvent(fd, ioEvents(false), &io_handler_) < 0) [[unlikely]] {
         SHLOG_ERROR("failed to register connector fd {} to epoll (blocking): {}", fd,
                     errno);
-        close();
+        close(CloseReason::Error);
         return -errno;
     }
 
     if (connect_cb_) {
         connect_cb_();
     }
-
-    SHLOG_INFO("TcpClient blocking connected to {}:{}", ip, port);
     return 0;
 }
 
 Message TcpClient::readAll() {
+    resumeReading();
     auto ret = rcv_buf_.getAllData();
     rcv_buf_.readCommit(ret.size_);
     return ret;
 }
 
 Message TcpClient::readUntil(char terminator) {
+    resumeReading();
     auto ret = rcv_buf_.getDataUntil(terminator);
     if (ret.data_ != nullptr) {
         // Consume the delimiter as well while returning line content only.
@@ -146,6 +232,7 @@ Message TcpClient::readUntil(char terminator) {
 }
 
 Message TcpClient::readUntilCRLF() {
+    resumeReading();
     auto ret = rcv_buf_.getDataUntilCRLF();
     if (ret.data_ != nullptr) {
         // Consume the delimiter as well while returning line content only.
@@ -154,7 +241,18 @@ Message TcpClient::readUntilCRLF() {
     return ret;
 }
 
+Message TcpClient::readUntil(std::string_view delimiter) {
+    resumeReading();
+    auto ret = rcv_buf_.getDataUntil(delimiter);
+    if (ret.data_ != nullptr) {
+        // Consume the delimiter as well while returning line content only.
+        rcv_buf_.readCommit(ret.size_ + delimiter.size());
+    }
+    return ret;
+}
+
 Message TcpClient::readn(size_t n) {
+    resumeReading();
     auto ret = rcv_buf_.getData(n);
     rcv_buf_.readCommit(ret.size_);
     return ret;
@@ -167,7 +265,7 @@ void TcpClient::handleIO(uint32_t events) {
 
     if (events & (EPOLLERR | EPOLLHUP)) [[unlikely]] {
         SHLOG_ERROR("connector fd {} got error/hup events: {}", conn_sk_.fd(), events);
-        close();
+        close(events & EPOLLERR ? CloseReason::Error : CloseReason::PeerClosed);
         return;
     }
 
@@ -179,8 +277,11 @@ void TcpClient::handleIO(uint32_t events) {
         }
     }
 
-    if (events & EPOLLIN) handleRead();
-    if (events & EPOLLOUT && !connect_in_progress_) handleWrite();
+    // Read callbacks and resumed readers may close the connection and drop
+    // the last reference to it.
+    auto self = weak_from_this().lock();
+    if (events & (EPOLLIN | EPOLLRDHUP)) handleRead(events & EPOLLRDHUP);
+    if (events & EPOLLOUT && !connect_in_progress_ && !closed_) handleWrite();
 }
 
 void TcpClient::handleConnect() {
@@ -192,7 +293,7 @@ void TcpClient::handleConnect() {
 
     if (err != 0) {
         SHLOG_ERROR("async connect failed on fd {}: {}", conn_sk_.fd(), err);
-        close();
+        close(CloseReason::Error);
         return;
     }
 
@@ -200,10 +301,11 @@ void TcpClient::handleConnect() {
     connected_ = true;
 
     // Connection established; stop listening for EPOLLOUT until we have data to send.
-    if (ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN, &io_handler_) < 0) [[unlikely]] {
+    if (!edge_triggered_ &&
+        ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN, &io_handler_) < 0) [[unlikely]] {
         SHLOG_ERROR("failed to switch connector fd {} to EPOLLIN: {}", conn_sk_.fd(),
                     errno);
-        close();
+        close(CloseReason::Error);
         return;
     }
 
@@ -214,39 +316,107 @@ void TcpClient::handleConnect() {
     SHLOG_INFO("TcpClient async connect succeeded on fd {}", conn_sk_.fd());
 }
 
-void TcpClient::handleRead() {
+void TcpClient::handleRead(bool peer_closing) {
     if (closed_) [[unlikely]] {
         SHLOG_WARN("handle read on closed connector fd {}", conn_sk_.fd());
         return;
     }
 
-    size_t len = rcv_buf_.writableSize();
-    if (len == 0) [[unlikely]] {
-        rcv_buf_.shrink();
-        len = rcv_buf_.writableSize();
+    // Level-triggered: one read per wakeup. Edge-triggered: keep reading
+    // until the socket is drained, since no further wakeup will come for data
+    // that is already queued. Bytes beyond the free space of the buffer land
+    // in the loop's scratch buffer and are appended afterwards, so a single
+    // readv() takes what the kernel has even into a small buffer.
+    rcv_buf_.acquire();
+    bool got_data = false;
+    bool peer_eof = false;
+    do {
+        size_t len = rcv_buf_.writableSize();
         if (len == 0) [[unlikely]] {
-            return;
+            rcv_buf_.shrink();
+            len = rcv_buf_.writableSize();
+        }
+        // Past MAX_UNREAD only room that was made on purpose is filled, e.g.
+        // for a frame or readnAsync(), unless a pending reader wants more.
+        const size_t extra = rcv_buf_.readableSize() < MAX_UNREAD || read_waiter_ != nullptr
+                                 ? EventLoop::READ_SCRATCH_SIZE
+                                 : 0;
+        if (len + extra == 0) [[unlikely]] {
+            pauseReading();
+            break;
         }
-    }
 
-    const ssize_t n = conn_sk_.read(rcv_buf_.writePointer(), len);
-    if (n <= 0) [[unlikely]] {
-        const int err = errno;
-        if (err == EAGAIN || err == EWOULDBLOCK) {
+        char* scratch = ev_loop_->readScratch();
+        const iovec iov[2] = {{rcv_buf_.writePointer(), len}, {scratch, extra}};
+        const ssize_t n = conn_sk_.readv(iov, 2);
+        if (n <= 0) [[unlikely]] {
+            const int err = errno;
+            if (n < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+                break;
+            }
+            if (n == 0 && got_data) {
+                // Hand what arrived before the FIN to the callbacks first.
+                peer_eof = true;
+                break;
+            }
+            if (n < 0) {
+                SHLOG_ERROR("connector handle read failed on fd {}: {}", conn_sk_.fd(), err);
+            } else {
+                SHLOG_INFO("peer reset connector on fd {}", conn_sk_.fd());
+            }
+            close(n < 0 ? closeReasonFor(err) : CloseReason::PeerClosed);
             return;
         }
-        if (n < 0) {
-            SHLOG_ERROR("connector handle read failed on fd {}: {}", conn_sk_.fd(), err);
+
+        if (static_cast<size_t>(n) <= len) {
+            rcv_buf_.writeCommit(static_cast<size_t>(n));
         } else {
-            SHLOG_INFO("peer reset connector on fd {}", conn_sk_.fd());
+            rcv_buf_.writeCommit(len);
+            rcv_buf_.write(scratch, static_cast<size_t>(n) - len);
         }
-        close();
-        return;
-    }
+        got_data = true;
+        timeouts_.onActivity();
+        // A short read means the socket receive queue is empty, unless the
+        // peer closed too: a FIN that came with the data gets no edge of its
+        // own, so read on until read() reports it.
+        if (static_cast<size_t>(n) < len + extra && !peer_closing) {
+            break;
+        }
+    } while (edge_triggered_);
 
-    rcv_buf_.writeCommit(static_cast<size_t>(n));
+    // A paused read that got nothing has nothing new to offer the callbacks.
+    if (got_data) {
+        dispatchRead();
+    }
+    if (peer_eof && !closed_) {
+        SHLOG_INFO("peer reset connector on fd {}", conn_sk_.fd());
+        close(CloseReason::PeerClosed);
+    }
+}
 
-    if (read_cb_) [[likely]] {
+void TcpClient::dispatchRead() {
+    if (read_waiter_ != nullptr && read_waiter_->tryRead()) {
+        read_waiter_->resume();
+        if (closed_) {
+            return;
+        }
+    }
+    if (frame_cb_) {
+        auto self = shared_from_this();
+        Message frame;
+        int ret;
+        while ((ret = frame_decoder_(rcv_buf_, frame)) > 0) {
+            frame_cb_(self, frame);
+            if (closed_) {
+                return;
+            }
+        }
+        if (ret < 0) [[unlikely]] {
+            SHLOG_ERROR("undecodable frame on fd {}: {}", conn_sk_.fd(), -ret);
+            close(CloseReason::Error);
+            return;
+        }
+    } else if (read_cb_) [[likely]] {
         while (rcv_buf_.readableSize() > 0) {
             int ret = read_cb_(shared_from_this());
             if (ret < 0) [[unlikely]] {
@@ -254,6 +424,11 @@ void TcpClient::handleRead() {
             }
         }
     }
+    if (!closed_) {
+        timeouts_.setReadPending(rcv_buf_.readableSize() > 0);
+        // Idle connections keep no receive buffer.
+        rcv_buf_.release();
+    }
 }
 
 void TcpClient::handleWrite() {
@@ -261,23 +436,25 @@ void TcpClient::handleWrite() {
         SHLOG_WARN("handle write on closed connector fd {}", conn_sk_.fd());
         return;
     }
+    iovec iov[MAX_FLUSH_IOV];
     while (!snd_buf_.empty()) {
-        auto n =
-            conn_sk_.send(snd_buf_.readPointer(), snd_buf_.readableSize(), MSG_NOSIGNAL);
+        const int cnt = snd_buf_.peek(iov, MAX_FLUSH_IOV);
+        auto n = conn_sk_.sendv(iov, cnt, MSG_NOSIGNAL);
 
         if (n > 0) [[likely]] {
             snd_buf_.readCommit(n);
+            timeouts_.onActivity();
             continue;
         }
 
         if (n < 0) [[unlikely]] {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // Socket send buffer is full; wait for the next EPOLLOUT.
-                return;
+                break;
             }
             SHLOG_ERROR("connector handle write failed on fd {}: {}", conn_sk_.fd(),
                         errno);
-            close();
+            close(closeReasonFor(errno));
             return;
         }
 
@@ -289,6 +466,7 @@ void TcpClient::handleWrite() {
     if (snd_buf_.empty()) {
         disableWrite();
     }
+    checkLowWatermark();
 }
 
 int TcpClient::sendBlocking(const char* data, size_t size) {
@@ -306,17 +484,19 @@ int TcpClient::sendBlocking(const char* data, size_t size) {
     }
 
     // drain send buffer
+    iovec iov[MAX_FLUSH_IOV];
     while (!snd_buf_.empty()) {
-        auto n =
-            conn_sk_.send(snd_buf_.readPointer(), snd_buf_.readableSize(), MSG_NOSIGNAL);
+        const int cnt = snd_buf_.peek(iov, MAX_FLUSH_IOV);
+        auto n = conn_sk_.sendv(iov, cnt, MSG_NOSIGNAL);
         if (n < 0) [[unlikely]] {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 continue;
             }
+            const int err = errno;
             SHLOG_ERROR("connector send blocking failed on fd {}: {}", conn_sk_.fd(),
-                        errno);
-            close();
-            return -errno;
+                        err);
+            close(closeReasonFor(err));
+            return -err;
         }
         snd_buf_.readCommit(n);
     }
@@ -331,14 +511,17 @@ int TcpClient::sendBlocking(const char* data, size_t size) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 continue;
             }
+            const int err = errno;
             SHLOG_ERROR("connector send blocking failed on fd {}: {}", conn_sk_.fd(),
-                        errno);
-            close();
-            return -errno;
+                        err);
+            close(closeReasonFor(err));
+            return -err;
         }
         data += static_cast<size_t>(n);
         size -= static_cast<size_t>(n);
     }
+    // Parked senders go after this call's data.
+    checkLowWatermark();
     return 0;
 }
 
@@ -362,14 +545,9 @@ int TcpClient::send(const char* data, size_t size) {
         return -ENOBUFS;
     }
 
-    if (snd_buf_.writableSize() < size) [[unlikely]] {
-        snd_buf_.shrink();
-    }
-
     // write enabled. append data and wait for the next epoll write event,
     if (snd_buf_.readableSize() > 0) [[unlikely]] {
-        snd_buf_.write(data, size);
-        enableWrite();
+        bufferSend(data, size);
         return 0;
     }
 
@@ -377,24 +555,94 @@ int TcpClient::send(const char* data, size_t size) {
 
     if (n < 0) [[unlikely]] {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            snd_buf_.write(data, size);
-            enableWrite();
+            bufferSend(data, size);
             return 0;
         }
         const int err = errno;
         SHLOG_ERROR("connector send failed on fd {}: {}", conn_sk_.fd(), err);
-        close();
+        close(closeReasonFor(err));
         return -err;
     }
 
+    timeouts_.onActivity();
     if (n < size) [[unlikely]] {
-        snd_buf_.write(data + n, size - n);
-        enableWrite();
+        bufferSend(data + n, size - n);
+    }
+
+    return 0;
+}
+
+int TcpClient::sendv(const struct iovec* iov, int iovcnt) {
+    if (iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt > 0 && !iov)) [[unlikely]] {
+        return -EINVAL;
+    }
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+    if (!connected_) [[unlikely]] {
+        return -ENOTCONN;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        size += iov[i].iov_len;
+    }
+    if (size == 0) [[unlikely]] {
+        return 0;
+    }
+
+    if (snd_buf_.getFreeSize() < size) [[unlikely]] {
+        SHLOG_WARN("connector send buffer overflow risk on fd {}: free {} < want {}", conn_sk_.fd(),
+                   snd_buf_.getFreeSize(), size);
+        return -ENOBUFS;
+    }
+
+    // write enabled. append data and wait for the next epoll write event,
+    if (snd_buf_.readableSize() > 0) [[unlikely]] {
+        bufferSendv(iov, iovcnt, 0);
+        return 0;
+    }
+
+    auto n = conn_sk_.sendv(iov, iovcnt, MSG_NOSIGNAL);
+
+    if (n < 0) [[unlikely]] {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            bufferSendv(iov, iovcnt, 0);
+            return 0;
+        }
+        const int err = errno;
+        SHLOG_ERROR("connector sendv failed on fd {}: {}", conn_sk_.fd(), err);
+        close(closeReasonFor(err));
+        return -err;
+    }
+
+    timeouts_.onActivity();
+    if (static_cast<size_t>(n) < size) [[unlikely]] {
+        bufferSendv(iov, iovcnt, static_cast<size_t>(n));
     }
 
     return 0;
 }
 
+int TcpClient::send(std::span<const std::span<const char>> pieces) {
+    if (pieces.size() > IOV_MAX) [[unlikely]] {
+        return -EINVAL;
+    }
+    // The usual header/body/trailer message stays on the stack.
+    std::array<iovec, 8> small{};
+    std::vector<iovec> large;
+    iovec* iov = small.data();
+    if (pieces.size() > small.size()) [[unlikely]] {
+        large.resize(pieces.size());
+        iov = large.data();
+    }
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        iov[i].iov_base = const_cast<char*>(pieces[i].data());
+        iov[i].iov_len = pieces[i].size();
+    }
+    return sendv(iov, static_cast<int>(pieces.size()));
+}
+
 shcoro::Async<int> TcpClient::sendAsync(const char* data, size_t size) {
     if (size == 0) [[unlikely]] {
         co_return 0;
@@ -409,18 +657,16 @@ shcoro::Async<int> TcpClient::sendAsync(const char* data, size_t size) {
         co_return -ENOTCONN;
     }
 
-    while (snd_buf_.getFreeSize() < size) {
-        co_await shcoro::FIFOAwaiter{};
-    }
-
-    if (snd_buf_.writableSize() < size) [[unlikely]] {
-        snd_buf_.shrink();
+    while (snd_buf_.getFreeSize() < size && !snd_buf_.empty()) {
+        co_await write_waiters_.wait();
+        if (closed_) [[unlikely]] {
+            co_return -ESHUTDOWN;
+        }
     }
 
     // write enabled. append data and wait for the next epoll write event,
     if (snd_buf_.readableSize() > 0) [[unlikely]] {
-        snd_buf_.write(data, size);
-        enableWrite();
+        bufferSend(data, size);
         co_return 0;
     }
 
@@ -428,65 +674,135 @@ shcoro::Async<int> TcpClient::sendAsync(const char* data, size_t size) {
 
     if (n < 0) [[unlikely]] {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            snd_buf_.write(data, size);
-            enableWrite();
+            bufferSend(data, size);
             co_return 0;
         }
         const int err = errno;
         SHLOG_ERROR("connector send failed on fd {}: {}", conn_sk_.fd(), err);
-        close();
+        close(closeReasonFor(err));
         co_return -err;
     }
 
+    timeouts_.onActivity();
     if (n < size) [[unlikely]] {
-        snd_buf_.write(data + n, size - n);
-        enableWrite();
+        bufferSend(data + n, size - n);
     }
 
     co_return 0;
 }
 
-void TcpClient::disableWrite() {
-    if (closed_) [[unlikely]] {
+void TcpClient::bufferSend(const char* data, size_t size) {
+    snd_buf_.write(data, size);
+    onSendBuffered();
+}
+
+void TcpClient::bufferSendv(const struct iovec* iov, int iovcnt, size_t skip) {
+    for (int i = 0; i < iovcnt; ++i) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        snd_buf_.write(static_cast<const char*>(iov[i].iov_base) + skip,
+                       iov[i].iov_len - skip);
+        skip = 0;
+    }
+    onSendBuffered();
+}
+
+void TcpClient::onSendBuffered() {
+    enableWrite();
+    if (!above_high_watermark_ && snd_buf_.readableSize() >= high_watermark_) {
+        above_high_watermark_ = true;
+        if (high_watermark_cb_) {
+            high_watermark_cb_(shared_from_this(), snd_buf_.readableSize());
+        }
+    }
+}
+
+void TcpClient::checkLowWatermark() {
+    if (snd_buf_.readableSize() > low_watermark_) {
         return;
     }
-    if (ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN, &io_handler_) < 0) [[unlikely]] {
-        SHLOG_ERROR("failed to disable EPOLLOUT for connector fd {}: {}", conn_sk_.fd(),
-                    errno);
+    if (above_high_watermark_) {
+        above_high_watermark_ = false;
+        if (low_watermark_cb_) {
+            low_watermark_cb_(shared_from_this(), snd_buf_.readableSize());
+        }
+    }
+    write_waiters_.resumeAll();
+}
+
+// enableWrite()/disableWrite() bracket a non-empty send buffer, which is
+// what the write deadline measures.
+void TcpClient::disableWrite() {
+    timeouts_.setWritePending(false);
+    if (closed_ || edge_triggered_) {
+        return;
     }
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(false), &io_handler_);
 }
 
 void TcpClient::enableWrite() {
-    if (closed_) [[unlikely]] {
+    timeouts_.setWritePending(true);
+    if (closed_ || edge_triggered_) {
         return;
     }
-    if (ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN | EPOLLOUT, &io_handler_) < 0)
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(true), &io_handler_);
+}
+
+void TcpClient::pauseReading() {
+    if (read_paused_ || closed_) {
+        return;
+    }
+    SHLOG_WARN("pausing reads on connector fd {}: {} bytes unread", conn_sk_.fd(),
+               rcv_buf_.readableSize());
+    read_paused_ = true;
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+}
+
+void TcpClient::unpauseReading() {
+    read_paused_ = false;
+    if (closed_) {
+        return;
+    }
+    if (!edge_triggered_) {
+        ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+        return;
+    }
+    // Edge-triggered, only an actual EPOLL_CTL_MOD reports the data that
+    // queued up while paused; a batched update may cancel out.
+    if (ev_loop_->modEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_) < 0)
         [[unlikely]] {
-        SHLOG_ERROR("failed to enable EPOLLOUT for connector fd {}: {}", conn_sk_.fd(),
-                    errno);
+        SHLOG_ERROR("failed to enable EPOLLIN for connector fd {}: {}", conn_sk_.fd(), errno);
     }
 }
 
 void TcpClient::setReadCallback(ReadCallback cb) { read_cb_ = cb; }
 
-void TcpClient::close() {
+void TcpClient::close(CloseReason reason) {
     if (closed_) [[unlikely]] {
         return;
     }
 
     const int fd = conn_sk_.fd();
-    SHLOG_INFO("TcpClient close: {}", fd);
+    SHLOG_INFO("TcpClient close: {} ({})", fd, toString(reason));
 
     closed_ = true;
+    timeouts_.stop();
 
     // Ensure epoll no longer references our in-object handler pointer.
     ev_loop_->delEvent(fd);
 
     if (close_cb_) {
-        close_cb_(fd);
+        close_cb_(fd, reason);
     }
 
     conn_sk_.close();
+
+    if (read_waiter_ != nullptr) {
+        read_waiter_->resume();
+    }
+    write_waiters_.resumeAll();
 }
 
 }  // namespace shnet
@@ -1,11 +1,16 @@
 #include "shnet/tcp_conn.h"
 
 #include <arpa/inet.h>
+#include <limits.h>
+#include <linux/errqueue.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <array>
 #include <cerrno>
+#include <vector>
 
 #include "shcoro/stackless/utility.hpp"
 #include "shnet/event_loop.h"
@@ -17,13 +22,46 @@ inline void TcpConn::ioTrampoline(void* obj, uint32_t events) {
     static_cast<TcpConn*>(obj)->handleIO(events);
 }
 
-TcpConn::TcpConn(int fd, EventLoop* loop) : conn_sk_(fd), ev_loop_(loop), closed_(false) {
+inline void TcpConn::timeoutTrampoline(void* obj, CloseReason reason) {
+    static_cast<TcpConn*>(obj)->close(reason);
+}
+
+inline void TcpConn::recvTrampoline(void* obj, const EventLoop::Completion& c) {
+    static_cast<TcpConn*>(obj)->handleRecv(c);
+}
+
+inline void TcpConn::sendTrampoline(void* obj, const EventLoop::Completion& c) {
+    static_cast<TcpConn*>(obj)->handleSendDone(c);
+}
+
+TcpConn::TcpConn(int fd, EventLoop* loop, bool edge_triggered, bool unix_domain)
+    : conn_sk_(fd),
+      ev_loop_(loop),
+      timeouts_(loop, this, &timeoutTrampoline),
+      rcv_buf_(&loop->messageBufferPool(), RCV_BUF_SIZE),
+      snd_buf_(&loop->blockPool(), MessageBuffer::DEFAULT_SIZE),
+      closed_(false),
+      edge_triggered_(edge_triggered),
+      unix_domain_(unix_domain),
+      async_recv_(loop->asyncIo()),
+      async_send_(loop->asyncIo()) {
     conn_sk_.setNonBlocking();
-    conn_sk_.setKeepAlive();
+    if (!unix_domain_) {
+        conn_sk_.setKeepAlive();
+    }
+    // Completions already report everything that arrived or was sent.
+    if (async_recv_) {
+        edge_triggered_ = false;
+    }
+    // Registered for errors and hangups even when EPOLLIN is not needed.
     io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
-    if (ev_loop_->addEvent(fd, EPOLLIN, &io_handler_) < 0) [[unlikely]] {
+    if (ev_loop_->addEvent(fd, ioEvents(false), &io_handler_) < 0) [[unlikely]] {
         SHLOG_ERROR("failed to register connection fd {} to epoll: {}", fd, errno);
-        close();
+        close(CloseReason::Error);
+        return;
+    }
+    if (async_recv_) {
+        submitRecv();
     }
 }
 
@@ -31,6 +69,14 @@ TcpConn::~TcpConn() {
     close();
 }
 
+uint32_t TcpConn::ioEvents(bool want_write) const {
+    const uint32_t in = read_paused_ || async_recv_ ? 0u : static_cast<uint32_t>(EPOLLIN);
+    if (edge_triggered_) {
+        return in | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    }
+    return want_write ? in | EPOLLOUT : in;
+}
+
 void TcpConn::removeFromServer() {
     if (removed_) [[unlikely]] {
         return;
@@ -40,36 +86,57 @@ void TcpConn::removeFromServer() {
     remove_conn_handler_(conn_sk_.fd());
 }
 
-void TcpConn::close() {
+void TcpConn::close(CloseReason reason) {
     if (closed_) [[unlikely]] {
         return;
     }
 
     const int fd = conn_sk_.fd();
-    SHLOG_INFO("TcpConn close: {}", fd);
+    SHLOG_INFO("TcpConn close: {} ({})", fd, toString(reason));
 
     closed_ = true;
+    timeouts_.stop();
+
+    // removeFromServer() may drop the last owning reference; stay alive until
+    // this function returns. Empty when called from the destructor.
+    auto self = weak_from_this().lock();
 
     // Ensure epoll no longer references our in-object handler pointer.
     ev_loop_->delEvent(fd);
+    if (recv_op_ >= 0) {
+        ev_loop_->detachOp(recv_op_);
+        recv_op_ = -1;
+    }
+    if (send_op_ >= 0) {
+        // Its completion lets go of send_self_.
+        ev_loop_->cancelOp(send_op_);
+    }
 
     // Drop server ownership (may destroy this object if nobody else holds it).
     removeFromServer();
 
     if (close_cb_) {
-        close_cb_(fd);
+        close_cb_(fd, reason);
     }
 
     conn_sk_.close();
+    releaseZeroCopy();
+
+    if (read_waiter_ != nullptr) {
+        read_waiter_->resume();
+    }
+    write_waiters_.resumeAll();
 }
 
 Message TcpConn::readAll() {
+    resumeReading();
     auto ret = rcv_buf_.getAllData();
     rcv_buf_.readCommit(ret.size_);
     return ret;
 }
 
 Message TcpConn::readUntil(char terminator) {
+    resumeReading();
     auto ret = rcv_buf_.getDataUntil(terminator);
     if (ret.data_ != nullptr) {
         // Consume the delimiter as well while returning line content only.
@@ -79,6 +146,7 @@ Message TcpConn::readUntil(char terminator) {
 }
 
 Message TcpConn::readUntilCRLF() {
+    resumeReading();
     auto ret = rcv_buf_.getDataUntilCRLF();
     if (ret.data_ != nullptr) {
         // Consume the delimiter as well while returning line content only.
@@ -87,7 +155,18 @@ Message TcpConn::readUntilCRLF() {
     return ret;
 }
 
+Message TcpConn::readUntil(std::string_view delimiter) {
+    resumeReading();
+    auto ret = rcv_buf_.getDataUntil(delimiter);
+    if (ret.data_ != nullptr) {
+        // Consume the delimiter as well while returning line content only.
+        rcv_buf_.readCommit(ret.size_ + delimiter.size());
+    }
+    return ret;
+}
+
 Message TcpConn::readn(size_t n) {
+    resumeReading();
     auto ret = rcv_buf_.getData(n);
     rcv_buf_.readCommit(ret.size_);
     return ret;
@@ -99,56 +178,242 @@ void TcpConn::handleIO(uint32_t events) {
     }
 
 
+    if (events & EPOLLERR) [[unlikely]] {
+        // Zero-copy completions are queued as socket errors too.
+        if (zerocopy_threshold_ > 0 && handleErrorQueue()) {
+            events &= ~EPOLLERR;
+        }
+    }
+
     if (events & (EPOLLERR | EPOLLHUP)) [[unlikely]] {
         SHLOG_ERROR("connection fd {} got error/hup events: {}", conn_sk_.fd(), events);
-        close();
+        close(events & EPOLLERR ? CloseReason::Error : CloseReason::PeerClosed);
         return;
     }
 
-    if (events & EPOLLIN) handleRead();
-    if (events & EPOLLOUT) handleWrite();
+    // Read callbacks and resumed readers may close the connection and drop
+    // the last reference to it.
+    auto self = weak_from_this().lock();
+    // The multishot receive takes the data, and the FIN, itself.
+    if (async_recv_) {
+        events &= ~(EPOLLIN | EPOLLRDHUP);
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP)) handleRead(events & EPOLLRDHUP);
+    if (events & EPOLLOUT && !closed_) handleWrite();
 }
 
-void TcpConn::handleRead() {
+void TcpConn::handleRead(bool peer_closing) {
     if (closed_) [[unlikely]] {
         SHLOG_WARN("handle read on closed connection fd {}", conn_sk_.fd());
         return;
     }
 
-    size_t len = rcv_buf_.writableSize();
-    if (len == 0) [[unlikely]] {
-        rcv_buf_.shrink();
-        len = rcv_buf_.writableSize();
+    // Level-triggered: one read per wakeup. Edge-triggered: keep reading
+    // until the socket is drained, since no further wakeup will come for data
+    // that is already queued. Bytes beyond the free space of the buffer land
+    // in the loop's scratch buffer and are appended afterwards, so a single
+    // readv() takes what the kernel has even into a small buffer.
+    rcv_buf_.acquire();
+    bool got_data = false;
+    do {
+        size_t len = rcv_buf_.writableSize();
         if (len == 0) [[unlikely]] {
+            rcv_buf_.shrink();
+            len = rcv_buf_.writableSize();
+        }
+        // Past MAX_UNREAD only room that was made on purpose is filled, e.g.
+        // for a frame or readnAsync(), unless a pending reader wants more.
+        const size_t extra = rcv_buf_.readableSize() < MAX_UNREAD || read_waiter_ != nullptr
+                                 ? EventLoop::READ_SCRATCH_SIZE
+                                 : 0;
+        if (len + extra == 0) [[unlikely]] {
+            pauseReading();
+            break;
+        }
+
+        char* scratch = ev_loop_->readScratch();
+        const iovec iov[2] = {{rcv_buf_.writePointer(), len}, {scratch, extra}};
+        const ssize_t n = conn_sk_.readv(iov, 2);
+        if (n <= 0) [[unlikely]] {
+            const int err = errno;
+            if (n < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+                break;
+            }
+            if (n == 0 && (got_data || read_deferred_)) {
+                // Hand what arrived before the FIN to the callbacks first.
+                peer_eof_ = true;
+                break;
+            }
+            if (n < 0) {
+                SHLOG_ERROR("handle read failed on fd {}: {}", conn_sk_.fd(), err);
+            } else {
+                SHLOG_INFO("peer reset connection on fd {}", conn_sk_.fd());
+            }
+            close(n < 0 ? closeReasonFor(err) : CloseReason::PeerClosed);
             return;
         }
+
+        if (static_cast<size_t>(n) <= len) {
+            rcv_buf_.writeCommit(static_cast<size_t>(n));
+        } else {
+            rcv_buf_.writeCommit(len);
+            rcv_buf_.write(scratch, static_cast<size_t>(n) - len);
+        }
+        got_data = true;
+        timeouts_.onActivity();
+        // A short read means the socket receive queue is empty, unless the
+        // peer closed too: a FIN that came with the data gets no edge of its
+        // own, so read on until read() reports it.
+        if (static_cast<size_t>(n) < len + extra && !peer_closing) {
+            break;
+        }
+    } while (edge_triggered_);
+
+    // A paused read that got nothing has nothing new to offer the callbacks,
+    // and a deferred dispatch picks up the new data with the rest.
+    if (got_data && !read_deferred_) {
+        dispatchRead();
+    }
+    if (peer_eof_) {
+        closeAtPeerEof();
+    }
+}
+
+// Closes after the peer's FIN once the data read before it was dispatched.
+void TcpConn::closeAtPeerEof() {
+    if (!closed_ && !read_deferred_) {
+        SHLOG_INFO("peer reset connection on fd {}", conn_sk_.fd());
+        close(CloseReason::PeerClosed);
     }
+}
 
-    const ssize_t n = conn_sk_.read(rcv_buf_.writePointer(), len);
-    if (n <= 0) [[unlikely]] {
-        const int err = errno;
-        if (err == EAGAIN || err == EWOULDBLOCK) {
+void TcpConn::submitRecv() {
+    recv_op_ = ev_loop_->recvMultishot(conn_sk_.fd(), {this, &recvTrampoline});
+    if (recv_op_ < 0) [[unlikely]] {
+        SHLOG_ERROR("failed to start receiving on fd {}, using EPOLLIN: {}", conn_sk_.fd(),
+                    errno);
+        async_recv_ = false;
+        ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+    }
+}
+
+// The async counterpart of handleRead(): the bytes were received already and
+// are copied into the receive buffer, so the poller can reuse its buffer right
+// after.
+void TcpConn::handleRecv(const EventLoop::Completion& c) {
+    if (!c.more) {
+        recv_op_ = -1;
+    }
+    if (closed_) [[unlikely]] {
+        return;
+    }
+    auto self = weak_from_this().lock();
+    if (c.res > 0) [[likely]] {
+        const size_t n = static_cast<size_t>(c.res);
+        // Past MAX_UNREAD, bytes beyond the room made on purpose, e.g. for a
+        // frame, are still taken but stop the receive, as handleRead() would.
+        const bool over = rcv_buf_.readableSize() >= MAX_UNREAD && read_waiter_ == nullptr &&
+                          rcv_buf_.getFreeSize() < n;
+        rcv_buf_.acquire();
+        rcv_buf_.write(c.data, n);
+        timeouts_.onActivity();
+        if (!read_deferred_) {
+            dispatchRead();
+        }
+        if (closed_) {
             return;
         }
-        if (n < 0) {
-            SHLOG_ERROR("handle read failed on fd {}: {}", conn_sk_.fd(), err);
-        } else {
-            SHLOG_INFO("peer reset connection on fd {}", conn_sk_.fd());
+        if (over) {
+            pauseReading();
         }
-        close();
+    } else if (c.res == 0) {
+        peer_eof_ = true;
+        closeAtPeerEof();
+        return;
+    } else if (c.res == -EINVAL) [[unlikely]] {
+        // Multishot receive needs Linux 6.0.
+        SHLOG_WARN("multishot receive unsupported on fd {}, using EPOLLIN", conn_sk_.fd());
+        async_recv_ = false;
+        ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+        return;
+    } else if (c.res != -ENOBUFS && c.res != -ECANCELED) [[unlikely]] {
+        SHLOG_ERROR("receive failed on fd {}: {}", conn_sk_.fd(), -c.res);
+        close(closeReasonFor(-c.res));
         return;
     }
+    // Ended because the poller ran out of buffers, or cancelled by a pause
+    // that was lifted in the meantime.
+    if (recv_op_ < 0 && !read_paused_) {
+        submitRecv();
+    }
+}
 
-    rcv_buf_.writeCommit(static_cast<size_t>(n));
-
-    if (read_cb_) [[likely]] {
+void TcpConn::dispatchRead() {
+    if (read_waiter_ != nullptr && read_waiter_->tryRead()) {
+        read_waiter_->resume();
+        if (closed_) {
+            return;
+        }
+    }
+    // Callbacks run until the buffer is drained or the read budget is spent.
+    const size_t start = rcv_buf_.readableSize();
+    size_t messages = 0;
+    if (frame_cb_) {
+        auto self = shared_from_this();
+        Message frame;
+        int ret;
+        while ((ret = frame_decoder_(rcv_buf_, frame)) > 0) {
+            frame_cb_(self, frame);
+            if (closed_) {
+                return;
+            }
+            if (readBudgetSpent(++messages, start - rcv_buf_.readableSize())) [[unlikely]] {
+                if (rcv_buf_.readableSize() > 0) {
+                    deferDispatch();
+                }
+                break;
+            }
+        }
+        if (ret < 0) [[unlikely]] {
+            SHLOG_ERROR("undecodable frame on fd {}: {}", conn_sk_.fd(), -ret);
+            close(CloseReason::Error);
+            return;
+        }
+    } else if (read_cb_) [[likely]] {
         while (rcv_buf_.readableSize() > 0) {
             int ret = read_cb_(shared_from_this());
             if (ret < 0) [[unlikely]] {
                 break;
             }
+            if (readBudgetSpent(++messages, start - rcv_buf_.readableSize())) [[unlikely]] {
+                if (rcv_buf_.readableSize() > 0) {
+                    deferDispatch();
+                }
+                break;
+            }
         }
     }
+    if (!closed_) {
+        timeouts_.setReadPending(rcv_buf_.readableSize() > 0);
+        // Idle connections keep no receive buffer.
+        rcv_buf_.release();
+    }
+}
+
+void TcpConn::deferDispatch() {
+    if (read_deferred_) {
+        return;
+    }
+    read_deferred_ = true;
+    ev_loop_->defer([self = shared_from_this()] {
+        self->read_deferred_ = false;
+        if (!self->closed_) {
+            self->dispatchRead();
+        }
+        if (self->peer_eof_) {
+            self->closeAtPeerEof();
+        }
+    });
 }
 
 void TcpConn::handleWrite() {
@@ -156,33 +421,116 @@ void TcpConn::handleWrite() {
         SHLOG_WARN("handle write on closed connection fd {}", conn_sk_.fd());
         return;
     }
+    if (send_op_ >= 0) {
+        return;  // continued by handleSendDone()
+    }
+    if (!flushSendBuffer(async_send_)) [[unlikely]] {
+        return;
+    }
+
+    if (snd_buf_.empty()) {
+        disableWrite();
+    }
+    checkLowWatermark();
+}
+
+bool TcpConn::flushSendBuffer(bool submit) {
+    iovec iov[MAX_FLUSH_IOV];
     while (!snd_buf_.empty()) {
-        auto n =
-            conn_sk_.send(snd_buf_.readPointer(), snd_buf_.readableSize(), MSG_NOSIGNAL);
+        if (submit && submitSend()) {
+            // The completion continues, not EPOLLOUT.
+            ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(false), &io_handler_);
+            break;
+        }
+        const ssize_t n = flushHead(iov);
 
         if (n > 0) [[likely]] {
             snd_buf_.readCommit(n);
+            timeouts_.onActivity();
             continue;
         }
 
         if (n < 0) [[unlikely]] {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 // Socket send buffer is full; wait for the next EPOLLOUT.
-                return;
+                if (async_send_) {
+                    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(true), &io_handler_);
+                }
+                break;
             }
             SHLOG_ERROR("handle write failed on fd {}: {}", conn_sk_.fd(), errno);
-            close();
-            return;
+            close(closeReasonFor(errno));
+            return false;
         }
 
         // send() returning 0 is unexpected here (len > 0); avoid a busy loop.
         SHLOG_WARN("send() returned 0 on fd {}: {}", conn_sk_.fd(), n);
         break;
     }
+    return true;
+}
+
+bool TcpConn::submitSend() {
+    off_t offset;
+    size_t size;
+    iovec head;
+    if (snd_buf_.peekFile(&offset, &size) >= 0 || snd_buf_.peekZeroCopy(&head) != nullptr) {
+        return false;
+    }
+    if (!send_msg_) {
+        send_msg_ = std::make_unique<SendMsg>();
+    }
+    msghdr& msg = send_msg_->msg;
+    msg = msghdr{};
+    msg.msg_iov = send_msg_->iov;
+    msg.msg_iovlen = static_cast<size_t>(snd_buf_.peek(send_msg_->iov, MAX_FLUSH_IOV));
+    send_op_ = ev_loop_->sendMsg(conn_sk_.fd(), &msg, {this, &sendTrampoline});
+    if (send_op_ < 0) [[unlikely]] {
+        return false;
+    }
+    send_self_ = shared_from_this();
+    return true;
+}
 
-    if (snd_buf_.empty()) {
-        disableWrite();
+void TcpConn::handleSendDone(const EventLoop::Completion& c) {
+    send_op_ = -1;
+    auto self = std::move(send_self_);
+    if (closed_) {
+        return;
     }
+    if (c.res < 0) [[unlikely]] {
+        if (c.res == -ECANCELED) {
+            // The loop stopped; the next run picks the rest up from EPOLLOUT.
+            ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(true), &io_handler_);
+            return;
+        }
+        SHLOG_ERROR("handle write failed on fd {}: {}", conn_sk_.fd(), -c.res);
+        close(closeReasonFor(-c.res));
+        return;
+    }
+    snd_buf_.readCommit(static_cast<size_t>(c.res));
+    timeouts_.onActivity();
+    handleWrite();
+}
+
+ssize_t TcpConn::flushHead(struct iovec* iov) {
+    off_t offset;
+    size_t size;
+    if (const int fd = snd_buf_.peekFile(&offset, &size); fd >= 0) {
+        const ssize_t n = conn_sk_.sendFile(fd, offset, size);
+        if (n == 0) [[unlikely]] {
+            // The file got shorter than queued; the stream can't continue.
+            SHLOG_ERROR("queued file {} ended early on fd {}", fd, conn_sk_.fd());
+            errno = EIO;
+            return -1;
+        }
+        return n;
+    }
+    if (SharedPayload* payload = snd_buf_.peekZeroCopy(iov)) {
+        return sendZeroCopy(iov[0], payload);
+    }
+    const int cnt = snd_buf_.peek(iov, MAX_FLUSH_IOV);
+    return conn_sk_.sendv(iov, cnt, MSG_NOSIGNAL);
 }
 
 int TcpConn::sendBlocking(const char* data, size_t size) {
@@ -196,17 +544,27 @@ int TcpConn::sendBlocking(const char* data, size_t size) {
         return -ESHUTDOWN;
     }
 
+    // A send operation in flight owns the front of the send buffer; its
+    // completion may start the next one.
+    while (send_op_ >= 0) {
+        ev_loop_->waitOp(send_op_);
+    }
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+
     // drain send buffer
+    iovec iov[MAX_FLUSH_IOV];
     while (!snd_buf_.empty()) {
-        auto n =
-            conn_sk_.send(snd_buf_.readPointer(), snd_buf_.readableSize(), MSG_NOSIGNAL);
+        auto n = flushHead(iov);
         if (n < 0) [[unlikely]] {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 continue;
             }
-            SHLOG_ERROR("send blocking failed on fd {}: {}", conn_sk_.fd(), errno);
-            close();
-            return -errno;
+            const int err = errno;
+            SHLOG_ERROR("send blocking failed on fd {}: {}", conn_sk_.fd(), err);
+            close(closeReasonFor(err));
+            return -err;
         }
         snd_buf_.readCommit(n);
     }
@@ -221,13 +579,16 @@ int TcpConn::sendBlocking(const char* data, size_t size) {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 continue;
             }
-            SHLOG_ERROR("send blocking failed on fd {}: {}", conn_sk_.fd(), errno);
-            close();
-            return -errno;
+            const int err = errno;
+            SHLOG_ERROR("send blocking failed on fd {}: {}", conn_sk_.fd(), err);
+            close(closeReasonFor(err));
+            return -err;
         }
         data += static_cast<size_t>(n);
         size -= static_cast<size_t>(n);
     }
+    // Parked senders go after this call's data.
+    checkLowWatermark();
     return 0;
 }
 
@@ -242,20 +603,13 @@ int TcpConn::send(const char* data, size_t size) {
         return -ESHUTDOWN;
     }
 
-    if (snd_buf_.getFreeSize() < size) [[unlikely]] {
-        SHLOG_WARN("send buffer overflow risk on fd {}: free {} < want {}", conn_sk_.fd(),
-                   snd_buf_.getFreeSize(), size);
-        return -ENOBUFS;
-    }
-
-    if (snd_buf_.writableSize() < size) [[unlikely]] {
-        snd_buf_.shrink();
+    if (const int ret = reserveSend(size, false); ret < 0) [[unlikely]] {
+        return ret;
     }
 
     // write enabled. append data and wait for the next epoll write event,
-    if (snd_buf_.readableSize() > 0) [[unlikely]] {
-        snd_buf_.write(data, size);
-        enableWrite();
+    if (!canSendDirectly()) [[unlikely]] {
+        bufferSend(data, size);
         return 0;
     }
 
@@ -263,24 +617,261 @@ int TcpConn::send(const char* data, size_t size) {
 
     if (n < 0) [[unlikely]] {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            snd_buf_.write(data, size);
-            enableWrite();
+            bufferSend(data, size);
             return 0;
         }
         const int err = errno;
         SHLOG_ERROR("send failed on fd {}: {}", conn_sk_.fd(), err);
-        close();
+        close(closeReasonFor(err));
         return -err;
     }
 
+    timeouts_.onActivity();
     if (n < size) [[unlikely]] {
-        snd_buf_.write(data + n, size - n);
-        enableWrite();
+        bufferSend(data + n, size - n);
     }
 
     return 0;
 }
 
+int TcpConn::sendv(const struct iovec* iov, int iovcnt) {
+    if (iovcnt < 0 || iovcnt > IOV_MAX || (iovcnt > 0 && !iov)) [[unlikely]] {
+        return -EINVAL;
+    }
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+        size += iov[i].iov_len;
+    }
+    if (size == 0) [[unlikely]] {
+        return 0;
+    }
+
+    if (const int ret = reserveSend(size, false); ret < 0) [[unlikely]] {
+        return ret;
+    }
+
+    // write enabled. append data and wait for the next epoll write event,
+    if (!canSendDirectly()) [[unlikely]] {
+        bufferSendv(iov, iovcnt, 0);
+        return 0;
+    }
+
+    auto n = conn_sk_.sendv(iov, iovcnt, MSG_NOSIGNAL);
+
+    if (n < 0) [[unlikely]] {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            bufferSendv(iov, iovcnt, 0);
+            return 0;
+        }
+        const int err = errno;
+        SHLOG_ERROR("sendv failed on fd {}: {}", conn_sk_.fd(), err);
+        close(closeReasonFor(err));
+        return -err;
+    }
+
+    timeouts_.onActivity();
+    if (static_cast<size_t>(n) < size) [[unlikely]] {
+        bufferSendv(iov, iovcnt, static_cast<size_t>(n));
+    }
+
+    return 0;
+}
+
+int TcpConn::send(const SharedPayload::Ref& payload) {
+    if (!payload) [[unlikely]] {
+        return -EINVAL;
+    }
+    const size_t size = payload->size();
+    if (size == 0) [[unlikely]] {
+        return 0;
+    }
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+
+    // The bytes are shared, so only the queue length is limited here.
+    if (const int ret = reserveSend(size, true); ret < 0) [[unlikely]] {
+        return ret;
+    }
+
+    const bool zerocopy = zerocopy_threshold_ > 0 && size >= zerocopy_threshold_;
+
+    // write enabled. queue the payload and wait for the next epoll write event,
+    if (!canSendDirectly()) [[unlikely]] {
+        snd_buf_.append(payload, 0, zerocopy);
+        onSendBuffered();
+        return 0;
+    }
+
+    ssize_t n;
+    if (zerocopy) {
+        const struct iovec iov = {const_cast<char*>(payload->data()), size};
+        n = sendZeroCopy(iov, payload.get());
+    } else {
+        n = conn_sk_.send(payload->data(), size, MSG_NOSIGNAL);
+    }
+
+    if (n < 0) [[unlikely]] {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            snd_buf_.append(payload, 0, zerocopy);
+            onSendBuffered();
+            return 0;
+        }
+        const int err = errno;
+        SHLOG_ERROR("send failed on fd {}: {}", conn_sk_.fd(), err);
+        close(closeReasonFor(err));
+        return -err;
+    }
+
+    timeouts_.onActivity();
+    if (static_cast<size_t>(n) < size) [[unlikely]] {
+        snd_buf_.append(payload, static_cast<size_t>(n), zerocopy);
+        onSendBuffered();
+    }
+
+    return 0;
+}
+
+int TcpConn::sendFile(int fd, off_t offset, size_t size) {
+    if (size == 0) [[unlikely]] {
+        return 0;
+    }
+    if (closed_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0) [[unlikely]] {
+        return -errno;
+    }
+    if (!S_ISREG(st.st_mode) || offset < 0 || offset > st.st_size ||
+        size > static_cast<uint64_t>(st.st_size - offset)) [[unlikely]] {
+        return -EINVAL;
+    }
+
+    bool partial = false;
+    if (canSendDirectly()) {
+        const ssize_t n = conn_sk_.sendFile(fd, offset, size);
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]] {
+            const int err = errno;
+            SHLOG_ERROR("sendfile failed on fd {}: {}", conn_sk_.fd(), err);
+            close(closeReasonFor(err));
+            return -err;
+        }
+        if (n > 0) {
+            timeouts_.onActivity();
+            partial = true;
+            offset += n;
+            size -= static_cast<size_t>(n);
+            if (size == 0) {
+                return 0;
+            }
+        }
+    }
+
+    // The queue outlives the caller's descriptor.
+    const int dup_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0) [[unlikely]] {
+        const int err = errno;
+        SHLOG_ERROR("failed to duplicate file {} for fd {}: {}", fd, conn_sk_.fd(), err);
+        if (partial) {
+            // The peer got part of the file and can't be sent the rest.
+            close(CloseReason::Error);
+        }
+        return -err;
+    }
+    snd_buf_.appendFile(dup_fd, offset, size);
+    onSendBuffered();
+    return 0;
+}
+
+int TcpConn::enableZeroCopy(size_t min_size) {
+    if (conn_sk_.setZeroCopy() < 0) {
+        return -errno;
+    }
+    zerocopy_threshold_ = min_size > 0 ? min_size : 1;
+    return 0;
+}
+
+ssize_t TcpConn::sendZeroCopy(const struct iovec& iov, SharedPayload* payload) {
+    auto n = conn_sk_.sendv(&iov, 1, MSG_NOSIGNAL | MSG_ZEROCOPY);
+    if (n < 0 && errno == ENOBUFS) [[unlikely]] {
+        // Out of socket option memory for completion records: copy this one.
+        return conn_sk_.sendv(&iov, 1, MSG_NOSIGNAL);
+    }
+    if (n > 0) {
+        // The kernel numbers every MSG_ZEROCOPY send that took data.
+        payload->ref();
+        zerocopy_pending_.push_back({zerocopy_seq_++, payload});
+    }
+    return n;
+}
+
+bool TcpConn::handleErrorQueue() {
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    while (true) {
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (conn_sk_.recvErrorQueue(&msg) < 0) {
+            break;  // drained
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            const bool recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                                 (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!recverr) {
+                continue;
+            }
+            struct sock_extended_err ee;
+            memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+            if (ee.ee_origin == SO_EE_ORIGIN_ZEROCOPY && ee.ee_errno == 0) {
+                // Sends ee_info..ee_data are done; TCP completes them in order.
+                completeZeroCopy(ee.ee_data);
+            }
+        }
+    }
+    return conn_sk_.getError() == 0;
+}
+
+void TcpConn::completeZeroCopy(uint32_t last) {
+    auto it = zerocopy_pending_.begin();
+    for (; it != zerocopy_pending_.end() && static_cast<int32_t>(it->seq - last) <= 0; ++it) {
+        it->payload->unref();
+    }
+    zerocopy_pending_.erase(zerocopy_pending_.begin(), it);
+}
+
+// The kernel may still transmit from pages it pinned after close; owners are
+// told at close rather than never.
+void TcpConn::releaseZeroCopy() {
+    for (ZeroCopySend& send : zerocopy_pending_) {
+        send.payload->unref();
+    }
+    zerocopy_pending_.clear();
+}
+
+int TcpConn::send(std::span<const std::span<const char>> pieces) {
+    if (pieces.size() > IOV_MAX) [[unlikely]] {
+        return -EINVAL;
+    }
+    // The usual header/body/trailer message stays on the stack.
+    std::array<iovec, 8> small{};
+    std::vector<iovec> large;
+    iovec* iov = small.data();
+    if (pieces.size() > small.size()) [[unlikely]] {
+        large.resize(pieces.size());
+        iov = large.data();
+    }
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        iov[i].iov_base = const_cast<char*>(pieces[i].data());
+        iov[i].iov_len = pieces[i].size();
+    }
+    return sendv(iov, static_cast<int>(pieces.size()));
+}
+
 shcoro::Async<int> TcpConn::sendAsync(const char* data, size_t size) {
     if (size == 0) [[unlikely]] {
         co_return 0;
@@ -292,18 +883,16 @@ shcoro::Async<int> TcpConn::sendAsync(const char* data, size_t size) {
         co_return -ESHUTDOWN;
     }
 
-    while (snd_buf_.getFreeSize() < size) {
-        co_await shcoro::FIFOAwaiter{};
-    }
-
-    if (snd_buf_.writableSize() < size) [[unlikely]] {
-        snd_buf_.shrink();
+    while (snd_buf_.getFreeSize() < size && !snd_buf_.empty()) {
+        co_await write_waiters_.wait();
+        if (closed_) [[unlikely]] {
+            co_return -ESHUTDOWN;
+        }
     }
 
     // write enabled. append data and wait for the next epoll write event,
-    if (snd_buf_.readableSize() > 0) [[unlikely]] {
-        snd_buf_.write(data, size);
-        enableWrite();
+    if (!canSendDirectly()) [[unlikely]] {
+        bufferSend(data, size);
         co_return 0;
     }
 
@@ -311,41 +900,167 @@ shcoro::Async<int> TcpConn::sendAsync(const char* data, size_t size) {
 
     if (n < 0) [[unlikely]] {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            snd_buf_.write(data, size);
-            enableWrite();
+            bufferSend(data, size);
             co_return 0;
         }
         const int err = errno;
         SHLOG_ERROR("send failed on fd {}: {}", conn_sk_.fd(), err);
-        close();
+        close(closeReasonFor(err));
         co_return -err;
     }
 
+    timeouts_.onActivity();
     if (n < size) [[unlikely]] {
-        snd_buf_.write(data + n, size - n);
-        enableWrite();
+        bufferSend(data + n, size - n);
     }
 
     co_return 0;
 }
 
-void TcpConn::disableWrite() {
-    if (closed_) [[unlikely]] {
+void TcpConn::bufferSend(const char* data, size_t size) {
+    snd_buf_.write(data, size);
+    onSendBuffered();
+}
+
+void TcpConn::bufferSendv(const struct iovec* iov, int iovcnt, size_t skip) {
+    for (int i = 0; i < iovcnt; ++i) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        snd_buf_.write(static_cast<const char*>(iov[i].iov_base) + skip,
+                       iov[i].iov_len - skip);
+        skip = 0;
+    }
+    onSendBuffered();
+}
+
+// With async sends a round's sends wait in the buffer for flushCoalesced();
+// when they leave no room, they are written to the socket first, whose buffer
+// would have taken them as direct sends.
+int TcpConn::reserveSend(size_t size, bool shared) {
+    auto fits = [&] { return snd_buf_.getFreeSize() >= size || (shared && snd_buf_.empty()); };
+    if (fits()) [[likely]] {
+        return 0;
+    }
+    if (async_send_ && send_op_ < 0) {
+        if (!flushSendBuffer(false)) [[unlikely]] {
+            return -ESHUTDOWN;
+        }
+        if (fits()) {
+            return 0;
+        }
+    }
+    SHLOG_WARN("send buffer overflow risk on fd {}: free {} < want {}", conn_sk_.fd(),
+               snd_buf_.getFreeSize(), size);
+    return -ENOBUFS;
+}
+
+void TcpConn::onSendBuffered() {
+    enableWrite();
+    if ((coalesce_ || async_send_) && !flush_scheduled_) {
+        flush_scheduled_ = true;
+        ev_loop_->defer([self = shared_from_this()] { self->flushCoalesced(); });
+    }
+    if (!above_high_watermark_ && snd_buf_.readableSize() >= high_watermark_) {
+        above_high_watermark_ = true;
+        if (high_watermark_cb_) {
+            high_watermark_cb_(shared_from_this(), snd_buf_.readableSize());
+        }
+    }
+}
+
+void TcpConn::setSendCoalescing(bool enable, bool cork) {
+    coalesce_ = enable;
+    cork_ = enable && cork && !unix_domain_ && !async_send_;
+}
+
+void TcpConn::flushCoalesced() {
+    flush_scheduled_ = false;
+    if (closed_ || snd_buf_.empty()) {
         return;
     }
-    if (ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN, &io_handler_) < 0)
-        [[unlikely]] {
-        SHLOG_ERROR("failed to disable EPOLLOUT for fd {}: {}", conn_sk_.fd(), errno);
+    // Corked, the kernel only sends full segments until uncorked, also across
+    // the separate calls a file or zero-copy segment takes.
+    if (cork_) {
+        conn_sk_.setCork(true);
+    }
+    handleWrite();
+    if (cork_ && !closed_) {
+        conn_sk_.setCork(false);
+    }
+}
+
+void TcpConn::checkLowWatermark() {
+    if (snd_buf_.readableSize() > low_watermark_) {
+        return;
+    }
+    if (above_high_watermark_) {
+        above_high_watermark_ = false;
+        if (low_watermark_cb_) {
+            low_watermark_cb_(shared_from_this(), snd_buf_.readableSize());
+        }
+    }
+    write_waiters_.resumeAll();
+}
+
+// enableWrite()/disableWrite() bracket a non-empty send buffer, which is
+// what the write deadline measures.
+void TcpConn::disableWrite() {
+    timeouts_.setWritePending(false);
+    if (closed_ || edge_triggered_) {
+        return;
     }
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(false), &io_handler_);
 }
 
 void TcpConn::enableWrite() {
-    if (closed_) [[unlikely]] {
+    timeouts_.setWritePending(true);
+    // Send operations wait for room themselves, see handleWrite().
+    if (closed_ || edge_triggered_ || async_send_) {
         return;
     }
-    if (ev_loop_->modEvent(conn_sk_.fd(), EPOLLIN | EPOLLOUT, &io_handler_) <
-        0) [[unlikely]] {
-        SHLOG_ERROR("failed to enable EPOLLOUT for fd {}: {}", conn_sk_.fd(), errno);
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(true), &io_handler_);
+}
+
+void TcpConn::pauseReading() {
+    if (read_paused_ || closed_) {
+        return;
+    }
+    SHLOG_WARN("pausing reads on fd {}: {} bytes unread", conn_sk_.fd(),
+               rcv_buf_.readableSize());
+    read_paused_ = true;
+    if (async_recv_) {
+        // Data received until the cancellation is taken as usual.
+        if (recv_op_ >= 0) {
+            ev_loop_->cancelOp(recv_op_);
+        }
+        return;
+    }
+    ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+}
+
+void TcpConn::unpauseReading() {
+    read_paused_ = false;
+    if (closed_) {
+        return;
+    }
+    if (async_recv_) {
+        // Still cancelling, handleRecv() starts over.
+        if (recv_op_ < 0 && !peer_eof_) {
+            submitRecv();
+        }
+        return;
+    }
+    if (!edge_triggered_) {
+        ev_loop_->updateEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_);
+        return;
+    }
+    // Edge-triggered, only an actual EPOLL_CTL_MOD reports the data that
+    // queued up while paused; a batched update may cancel out.
+    if (ev_loop_->modEvent(conn_sk_.fd(), ioEvents(!snd_buf_.empty()), &io_handler_) < 0)
+        [[unlikely]] {
+        SHLOG_ERROR("failed to enable EPOLLIN for fd {}: {}", conn_sk_.fd(), errno);
     }
 }
 
@@ -354,24 +1069,37 @@ void TcpConn::setReadCallback(ReadCallback cb) {
 }
 
 void TcpConn::subscribe() {
-    if (owner_server_) {
-        SHLOG_INFO("subscribe to server, fd: {}", conn_sk_.fd());
-        owner_server_->subscribe(conn_sk_.fd());
-    }
+    subscribe("");
 }
 
 void TcpConn::unsubscribe() {
+    unsubscribe("");
+}
+
+int TcpConn::subscribe(std::string_view filter) {
+    if (!owner_server_) [[unlikely]] {
+        return -ESHUTDOWN;
+    }
+    SHLOG_INFO("subscribe to topic '{}', fd: {}", filter, conn_sk_.fd());
+    return owner_server_->subscribe(conn_sk_.fd(), filter);
+}
+
+void TcpConn::unsubscribe(std::string_view filter) {
     if (owner_server_) {
-        SHLOG_INFO("unsubscribe to server, fd: {}", conn_sk_.fd());
-        owner_server_->unsubscribe(conn_sk_.fd());
+        SHLOG_INFO("unsubscribe from topic '{}', fd: {}", filter, conn_sk_.fd());
+        owner_server_->unsubscribe(conn_sk_.fd(), filter);
     }
 }
 
 int TcpConn::broadcast(const char* data, size_t size) {
+    return broadcast("", data, size);
+}
+
+int TcpConn::broadcast(std::string_view topic, const char* data, size_t size) {
     if (!owner_server_) [[unlikely]] {
         return -ESHUTDOWN;
     }
-    return owner_server_->broadcast(data, size);
+    return owner_server_->broadcast(topic, data, size);
 }
 
 }  // namespace shnet
\ No newline at end of file
@@ -1,112 +1,525 @@
 #include "shnet/tcp_server.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cerrno>
 #include <iostream>
+#include <latch>
+#include <string>
+#include <system_error>
+#include <vector>
 
 #include "shnet/event_loop.h"
 #include "shnet/tcp_conn.h"
 
 namespace shnet {
 
+namespace {
+
+// Only a refused connection proves nobody accepts on the socket file anymore;
+// a full backlog or any other error may still mean a live server.
+bool staleUnixSocket(const UnixAddress& addr) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) [[unlikely]] {
+        return false;
+    }
+    const bool stale = ::connect(fd, addr.sockAddr(), addr.length()) < 0 && errno == ECONNREFUSED;
+    ::close(fd);
+    return stale;
+}
+
+}  // namespace
+
 inline void TcpServer::acceptTrampoline(void* obj, uint32_t events) {
-    static_cast<TcpServer*>(obj)->handleAccept(events);
+    auto* listener = static_cast<Listener*>(obj);
+    listener->server->handleAccept(*listener, events);
+}
+
+inline void TcpServer::acceptCompletionTrampoline(void* obj, const EventLoop::Completion& c) {
+    auto* listener = static_cast<Listener*>(obj);
+    listener->server->handleAcceptCompletion(*listener, c);
+}
+
+inline void TcpServer::resumeAcceptTrampoline(void* obj) {
+    auto* listener = static_cast<Listener*>(obj);
+    listener->server->resumeAccept(*listener);
 }
 
 inline void TcpServer::removeConnTrampoline(void* obj, int fd) {
     static_cast<TcpServer*>(obj)->removeConn(fd);
 }
 
-TcpServer::TcpServer(EventLoop* loop)
-    : ev_loop_(loop), listen_sk_([] {
-          int fd = socket(AF_INET, SOCK_STREAM, 0);
-          if (fd == -1) [[unlikely]] {
-              throw std::system_error(errno, std::system_category(),
-                                      "fail to create server listen fd");
-          }
-          return fd;
-      }()) {}
+TcpServer::Listener::Listener(TcpServer* s, EventLoop* l, int fd)
+    : server(s), loop(l), sk(fd), spare_fd(::open("/dev/null", O_RDONLY | O_CLOEXEC)) {}
 
-TcpServer::~TcpServer() {}
+TcpServer::Listener::~Listener() {
+    if (spare_fd >= 0) {
+        ::close(spare_fd);
+    }
+}
+
+TcpServer::TcpServer(EventLoop* loop) : ev_loop_(loop) {}
+
+TcpServer::~TcpServer() {
+    if (loop_pool_) {
+        // Join the I/O threads first so connections can be torn down here
+        // without racing their loops.
+        loop_pool_->stop();
+    }
+    // Loops are stopped (or this is the base loop's thread), so their
+    // timer wheels can be touched from here.
+    for (auto& listener : listeners_) {
+        if (listener->retry_timer.gen != 0) {
+            listener->loop->cancelTimer(listener->retry_timer);
+        }
+        if (listener->accept_op >= 0) {
+            listener->loop->detachOp(listener->accept_op);
+        }
+    }
+    {
+        ConnMap conns;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            conns.swap(conn_map_);
+        }
+    }
+    // Destroy the I/O loops, and whatever they still hold, while the
+    // connection map and its mutex are alive.
+    loop_pool_.reset();
+    // Leave the path alone if the file there is no longer the one we bound.
+    struct stat st;
+    if (!unix_path_.empty() && ::stat(unix_path_.c_str(), &st) == 0 &&
+        st.st_dev == unix_dev_ && st.st_ino == unix_ino_) {
+        ::unlink(unix_path_.c_str());
+    }
+}
 
 
 inline void TcpServer::removeConn(int fd) {
-    subscribers_.erase(fd); 
-    conn_map_.erase(fd);
+    std::shared_ptr<TcpConn> conn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        topics_.unsubscribeAll(fd);
+        auto it = conn_map_.find(fd);
+        if (it == conn_map_.end()) {
+            return;
+        }
+        conn = std::move(it->second);
+        conn_map_.erase(it);
+    }
+    // conn may be released here, outside of the lock.
+}
+
+EventLoop* TcpServer::selectLoop(int fd) {
+    if (!loop_pool_) {
+        return ev_loop_;
+    }
+    if (load_balance_ == LoadBalance::FdHash) {
+        return loop_pool_->getLoopForHash(static_cast<size_t>(fd));
+    }
+    return loop_pool_->getNextLoop();
 }
 
-void TcpServer::handleAccept(uint32_t events) {
+// Runs on the loop that will own the connection.
+void TcpServer::newConn(int fd, EventLoop* loop, bool unix_domain) {
+    auto conn = std::make_shared<TcpConn>(fd, loop, edge_triggered_, unix_domain);
+    conn->owner_server_ = this;
+    conn->setRemoveConnHandler({this, &removeConnTrampoline});
+    if (new_conn_cb_) [[likely]] {
+        new_conn_cb_(conn);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    conn_map_.emplace(fd, std::move(conn));
+}
+
+void TcpServer::handleAccept(Listener& listener, uint32_t events) {
     if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) [[unlikely]] {
-        SHLOG_ERROR("listen socket error events: {}", events);
+        SHLOG_ERROR("listen socket {} error events: {}", listener.sk.fd(), events);
         return;
     }
 
     if (events & EPOLLIN) [[likely]] {
-        sockaddr_in client_addr{};
-        socklen_t len = sizeof(client_addr);
+        acceptBatch(listener);
+    }
+}
+
+// Accepts up to accept_budget_ connections so a reconnect storm cannot starve
+// I/O on established connections. Level-triggered listen fds simply fire
+// again on the next round; edge-triggered ones get the rest of their queue
+// processed after the other ready events.
+void TcpServer::acceptBatch(Listener& listener) {
+    const int listen_fd = listener.sk.fd();
+    for (size_t i = 0; i < accept_budget_; ++i) {
         int conn_fd =
-            ::accept4(listen_sk_.fd(), (sockaddr*)&client_addr, &len, SOCK_NONBLOCK);
+            ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (conn_fd == -1) [[unlikely]] {
-            SHLOG_ERROR("accept4 failed on listen fd {}: {}", listen_sk_.fd(), errno);
+            const int err = errno;
+            if (err == EAGAIN || err == EWOULDBLOCK) {
+                return;
+            }
+            if (err == EINTR || err == ECONNABORTED) {
+                continue;
+            }
+            if (err == EMFILE || err == ENFILE) {
+                if (shedConn(listener)) {
+                    continue;
+                }
+                return;
+            }
+            accept_counters_.errors.fetch_add(1, std::memory_order_relaxed);
+            SHLOG_ERROR("accept4 failed on listen fd {}: {}", listen_fd, err);
+            if (edge_triggered_) {
+                // The queue may not be drained and no new edge will say so.
+                pauseAccept(listener);
+            }
             return;
         }
+        accept_counters_.accepted.fetch_add(1, std::memory_order_relaxed);
+        handOff(listener, conn_fd);
+    }
+
+    accept_counters_.budget_exhausted.fetch_add(1, std::memory_order_relaxed);
+    if (edge_triggered_) {
+        listener.loop->queueInLoop([this, &listener] { acceptBatch(listener); });
+    }
+}
 
-        auto conn = std::make_shared<TcpConn>(conn_fd, ev_loop_);
-        conn->owner_server_ = this;
-        conn->setRemoveConnHandler({this, &removeConnTrampoline});
-        if (new_conn_cb_) [[likely]] {
-            new_conn_cb_(conn);
+// The multishot accept ends on errors, which are handled as acceptBatch()
+// does, and is armed again unless accepting was paused.
+void TcpServer::handleAcceptCompletion(Listener& listener, const EventLoop::Completion& c) {
+    if (!c.more) {
+        listener.accept_op = -1;
+    }
+    if (c.res >= 0) [[likely]] {
+        accept_counters_.accepted.fetch_add(1, std::memory_order_relaxed);
+        handOff(listener, c.res);
+    } else if (c.res == -EMFILE || c.res == -ENFILE) {
+        // The operation takes an fd before looking at the queue, so it fails
+        // again right away while there is nothing left to shed.
+        if (!shedConn(listener)) {
+            pauseAccept(listener);
         }
-        conn_map_.emplace(conn_fd, std::move(conn));
+    } else if (c.res != -EINTR && c.res != -ECONNABORTED) {
+        accept_counters_.errors.fetch_add(1, std::memory_order_relaxed);
+        SHLOG_ERROR("accept failed on listen fd {}: {}", listener.sk.fd(), -c.res);
+        pauseAccept(listener);
+    }
+    if (listener.accept_op < 0 && listener.retry_timer.gen == 0 && armListener(listener) < 0)
+        [[unlikely]] {
+        SHLOG_ERROR("failed to re-arm accept on listen fd {}: {}", listener.sk.fd(), errno);
+        pauseAccept(listener);
     }
 }
 
-void TcpServer::start(uint16_t port, NewConnCallback cb) {
-    listen_sk_.setNonBlocking();
-    listen_sk_.setReusable();
-    listen_sk_.setKeepAlive();
+void TcpServer::handOff(Listener& listener, int conn_fd) {
+    if (sharded_listen_ && !listener.unix_domain) {
+        // The shard that accepted owns the connection.
+        newConn(conn_fd, listener.loop, listener.unix_domain);
+        return;
+    }
+
+    EventLoop* io_loop = selectLoop(conn_fd);
+    const bool unix_domain = listener.unix_domain;
+    io_loop->runInLoop([this, conn_fd, io_loop, unix_domain] {
+        newConn(conn_fd, io_loop, unix_domain);
+    });
+}
+
+// Out of fds: release the reserved fd, accept the pending connection and
+// close it right away. The peer gets a prompt close instead of a handshake
+// stuck in the backlog, and the listen fd stops reporting readable.
+//
+// Returns whether acceptBatch should go on. When it should not although
+// connections may still be queued, the listener is paused: an edge-triggered
+// one would otherwise wait for the next SYN to be reported again.
+bool TcpServer::shedConn(Listener& listener) {
+    const int listen_fd = listener.sk.fd();
+    if (listener.spare_fd < 0) [[unlikely]] {
+        listener.spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        accept_counters_.errors.fetch_add(1, std::memory_order_relaxed);
+        SHLOG_ERROR("out of fds and no spare fd on listen fd {}", listen_fd);
+        if (listener.spare_fd >= 0) {
+            // Fds were freed meanwhile; retry with the spare to fall back on.
+            return true;
+        }
+        // Nothing to shed with: a level-triggered listener would report the
+        // same pending connection every round.
+        pauseAccept(listener);
+        return false;
+    }
+    ::close(listener.spare_fd);
+    int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    const int err = errno;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    listener.spare_fd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (err == EINTR || err == ECONNABORTED) {
+            return true;
+        }
+        // EAGAIN means the queue drained in the meantime. Anything else, such
+        // as another thread taking the freed fd first, leaves it pending.
+        if (err != EAGAIN && err != EWOULDBLOCK && edge_triggered_) {
+            pauseAccept(listener);
+        }
+        return false;
+    }
+    accept_counters_.rejected.fetch_add(1, std::memory_order_relaxed);
+    SHLOG_WARN("out of fds, shed a connection on listen fd {}", listen_fd);
+    return true;
+}
+
+// Stops polling the listen socket for ACCEPT_RETRY_MS. Runs on its loop.
+void TcpServer::pauseAccept(Listener& listener) {
+    if (listener.retry_timer.gen != 0) {
+        return;
+    }
+    if (!listener.multishot) {
+        listener.loop->delEvent(listener.sk.fd());
+    } else if (listener.accept_op >= 0) {
+        // Connections it still accepted meanwhile are closed.
+        listener.loop->detachOp(listener.accept_op);
+        listener.accept_op = -1;
+    }
+    listener.retry_timer =
+        listener.loop->runAfter(ACCEPT_RETRY_MS, &resumeAcceptTrampoline, &listener);
+}
+
+void TcpServer::resumeAccept(Listener& listener) {
+    listener.retry_timer = {};
+    const int fd = listener.sk.fd();
+    if (armListener(listener) < 0) [[unlikely]] {
+        SHLOG_ERROR("failed to re-register listen fd {}: {}", fd, errno);
+        listener.retry_timer =
+            listener.loop->runAfter(ACCEPT_RETRY_MS, &resumeAcceptTrampoline, &listener);
+    }
+}
+
+TcpServer::AcceptStats TcpServer::acceptStats() const {
+    return AcceptStats{
+        accept_counters_.accepted.load(std::memory_order_relaxed),
+        accept_counters_.rejected.load(std::memory_order_relaxed),
+        accept_counters_.errors.load(std::memory_order_relaxed),
+        accept_counters_.budget_exhausted.load(std::memory_order_relaxed),
+    };
+}
+
+void TcpServer::listenOn(EventLoop* loop, uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) [[unlikely]] {
+        throw std::system_error(errno, std::system_category(),
+                                "fail to create server listen fd");
+    }
+    auto listener = std::make_unique<Listener>(this, loop, fd);
+
+    TcpSocket& sk = listener->sk;
+    sk.setNonBlocking();
+    sk.setReusable();
+    sk.setKeepAlive();
 
-    int ret = listen_sk_.bind(port);
-    if (ret < 0) [[unlikely]] {
+    if (sk.bind(port) < 0) [[unlikely]] {
         throw std::system_error(errno, std::system_category(), "bind failed");
     }
 
-    ret = listen_sk_.listen();
-    if (ret < 0) [[unlikely]] {
+    if (sk.listen() < 0) [[unlikely]] {
         throw std::system_error(errno, std::system_category(), "listen failed");
     }
 
-    new_conn_cb_ = cb;
-    accept_handler_ = EventLoop::EventHandler{this, &acceptTrampoline};
-    if (ev_loop_->addEvent(listen_sk_.fd(), EPOLLIN, &accept_handler_) < 0) [[unlikely]] {
+    registerListener(loop, std::move(listener));
+}
+
+void TcpServer::listenUnixOn(EventLoop* loop, const std::string& path) {
+    UnixAddress addr(path);
+    if (!addr.valid()) [[unlikely]] {
+        throw std::system_error(EINVAL, std::system_category(), "invalid unix socket path");
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) [[unlikely]] {
         throw std::system_error(errno, std::system_category(),
+                                "fail to create server listen fd");
+    }
+    auto listener = std::make_unique<Listener>(this, loop, fd);
+    listener->unix_domain = true;
+
+    TcpSocket& sk = listener->sk;
+    sk.setNonBlocking();
+
+    if (!addr.isAbstract()) {
+        // A socket file left behind by a previous run would fail the bind;
+        // one a running server still accepts on is not ours to remove.
+        struct stat st;
+        if (::stat(addr.path(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            if (!staleUnixSocket(addr)) {
+                throw std::system_error(EADDRINUSE, std::system_category(),
+                                        "unix socket path in use");
+            }
+            ::unlink(addr.path());
+        }
+    }
+
+    if (sk.bind(addr) < 0) [[unlikely]] {
+        throw std::system_error(errno, std::system_category(), "bind failed");
+    }
+    struct stat st;
+    if (!addr.isAbstract() && ::stat(addr.path(), &st) == 0) {
+        unix_path_ = addr.path();
+        unix_dev_ = st.st_dev;
+        unix_ino_ = st.st_ino;
+    }
+
+    if (sk.listen() < 0) [[unlikely]] {
+        throw std::system_error(errno, std::system_category(), "listen failed");
+    }
+
+    registerListener(loop, std::move(listener));
+}
+
+// Shard loops are already running; register on their own thread, which the
+// pollers and the loop's interest table require, and wait for the result.
+void TcpServer::registerListener(EventLoop* loop, std::unique_ptr<Listener> listener) {
+    listener->handler = EventLoop::EventHandler{listener.get(), &acceptTrampoline};
+    listener->events = edge_triggered_ ? EPOLLIN | EPOLLET : EPOLLIN;
+    listener->multishot = loop->asyncIo();
+    Listener* l = listener.get();
+
+    int err = 0;
+    std::latch done(1);
+    loop->runInLoop([this, l, &err, &done] {
+        if (armListener(*l) < 0) [[unlikely]] {
+            err = errno;
+        }
+        done.count_down();
+    });
+    done.wait();
+    if (err != 0) [[unlikely]] {
+        throw std::system_error(err, std::system_category(),
                                 "failed to register listen socket to epoll");
     }
-    SHLOG_INFO("TcpServer started on port: {}", port);
+    listeners_.push_back(std::move(listener));
+}
+
+// Multishot accept where the loop runs I/O itself, readiness otherwise.
+int TcpServer::armListener(Listener& listener) {
+    const int fd = listener.sk.fd();
+    if (listener.multishot) {
+        listener.accept_op = listener.loop->acceptMultishot(
+            fd, EventLoop::CompletionHandler{&listener, &acceptCompletionTrampoline});
+        return listener.accept_op < 0 ? -1 : 0;
+    }
+    return listener.loop->addEvent(fd, listener.events, &listener.handler);
 }
 
-void TcpServer::subscribe(int fd) {
-    subscribers_.insert(fd);
+void TcpServer::startLoopPool() {
+    if (num_threads_ > 0 && !loop_pool_) {
+        loop_pool_ = std::make_unique<EventLoopThreadPool>(ev_loop_, num_threads_);
+        loop_pool_->setCpuAffinity(sharded_listen_ && steer_by_cpu_);
+        loop_pool_->start();
+    }
 }
 
-void TcpServer::unsubscribe(int fd) {
-    subscribers_.erase(fd);
+void TcpServer::start(uint16_t port, NewConnCallback cb) {
+    new_conn_cb_ = cb;
+    startLoopPool();
+
+    if (!sharded_listen_ || !loop_pool_) {
+        listenOn(ev_loop_, port);
+        SHLOG_INFO("TcpServer started on port: {}", port);
+        return;
+    }
+
+    // The reuseport group index of a socket is its bind order, which must
+    // match the CPU the shard is pinned to for the BPF steering below.
+    for (EventLoop* loop : loop_pool_->getAllLoops()) {
+        listenOn(loop, port);
+    }
+
+    if (steer_by_cpu_) {
+        if (listeners_.front()->sk.attachReusePortCpuBpf(listeners_.size()) < 0) {
+            SHLOG_WARN("reuseport cpu steering unavailable, using kernel hash: {}", errno);
+        }
+    }
+    SHLOG_INFO("TcpServer started on port: {} with {} listen shards", port,
+               listeners_.size());
 }
 
-int TcpServer::broadcast(const char* data, size_t size) {
+void TcpServer::startUnix(const std::string& path, NewConnCallback cb) {
+    new_conn_cb_ = cb;
+    startLoopPool();
+
+    // AF_UNIX has no SO_REUSEPORT groups, so one listener always hands the
+    // connections out, even with sharded listening configured.
+    listenUnixOn(ev_loop_, path);
+    SHLOG_INFO("TcpServer started on unix socket: {}", path);
+}
+
+int TcpServer::subscribe(int fd, std::string_view filter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return topics_.subscribe(fd, filter);
+}
+
+void TcpServer::unsubscribe(int fd, std::string_view filter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    topics_.unsubscribe(fd, filter);
+}
+
+int TcpServer::broadcast(std::string_view topic, const char* data, size_t size) {
     if (!data || size == 0) {
         return 0;
     }
+    return broadcast(topic, SharedPayload::create(data, size));
+}
 
-    int last_err = 0;
-    for (int fd : subscribers_) {
-        auto it = conn_map_.find(fd);
-        if (it == conn_map_.end()) {
-            continue;  // connection already gone
+int TcpServer::broadcast(std::string_view topic, const SharedPayload::Ref& payload) {
+    if (!payload || payload->size() == 0) {
+        return 0;
+    }
+
+    // Snapshot the targets, grouped by loop: a failing send closes its
+    // connection, which re-enters removeConn() and takes the lock. There are
+    // only a few loops, so a linear lookup finds a target's group.
+    using ConnList = std::vector<std::shared_ptr<TcpConn>>;
+    std::vector<std::pair<EventLoop*, ConnList>> groups;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        match_fds_.clear();
+        topics_.match(topic, match_fds_);
+        for (int fd : match_fds_) {
+            auto it = conn_map_.find(fd);
+            if (it == conn_map_.end()) {
+                continue;  // connection already gone
+            }
+            EventLoop* loop = it->second->getEventLoop();
+            auto group = std::find_if(groups.begin(), groups.end(),
+                                      [loop](const auto& g) { return g.first == loop; });
+            if (group == groups.end()) {
+                group = groups.emplace(groups.end(), loop, ConnList{});
+            }
+            group->second.push_back(it->second);
         }
-        int ret = it->second->send(data, size);
-        if (ret < 0) {
-            last_err = ret;
+    }
+
+    // One queued functor per foreign loop, however many subscribers it has.
+    int last_err = 0;
+    for (auto& [loop, conns] : groups) {
+        if (loop->isInLoopThread()) {
+            for (auto& conn : conns) {
+                int ret = conn->send(payload);
+                if (ret < 0) {
+                    last_err = ret;
+                }
+            }
+            continue;
         }
+        loop->queueInLoop([conns = std::move(conns), payload] {
+            for (auto& conn : conns) {
+                conn->send(payload);
+            }
+        });
     }
     return last_err;
 }
@@ -1,10 +1,17 @@
 #include "shnet/tcp_socket.h"
 
+#include <linux/filter.h>
+#include <sys/sendfile.h>
+
 #include <cerrno>
 #include <stdexcept>
 
 #include "shlog/logger.h"
 
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+
 namespace shnet {
 // NOTE: check fd != -1 before setting
 TcpSocket::TcpSocket(int fd) : sockfd_(fd) {}
@@ -18,6 +25,13 @@ void TcpSocket::setNoDelay() {
     }
 }
 
+void TcpSocket::setCork(bool on) {
+    int cork = on ? 1 : 0;
+    if (::setsockopt(sockfd_, SOL_TCP, TCP_CORK, &cork, sizeof(cork)) < 0) {
+        SHLOG_ERROR("setsockopt TCP_CORK failed for fd {}: {}", sockfd_, errno);
+    }
+}
+
 void TcpSocket::setReusable() {
     int reuse_addr = 1;
     if (::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr)) < 0) {
@@ -72,6 +86,24 @@ void TcpSocket::setKeepAlive() {
     }
 }
 
+int TcpSocket::setZeroCopy() {
+    int enable = 1;
+    int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable));
+    if (ret < 0) {
+        SHLOG_ERROR("setsockopt SO_ZEROCOPY failed for fd {}: {}", sockfd_, errno);
+    }
+    return ret;
+}
+
+int TcpSocket::getError() const {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (::getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        return errno;
+    }
+    return err;
+}
+
 void TcpSocket::setRcvBufSize(int rcvBufSize) {
     if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize)) < 0) {
         SHLOG_ERROR("setsockopt SO_RCVBUF failed for fd {}: {}", sockfd_, errno);
@@ -84,6 +116,30 @@ void TcpSocket::setSndBufSize(int sndBufSize) {
     }
 }
 
+int TcpSocket::attachReusePortCpuBpf(uint32_t groups) {
+    if (groups == 0) [[unlikely]] {
+        errno = EINVAL;
+        return -1;
+    }
+    // A = cpu; A %= groups; return A
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, groups},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+    int ret = ::setsockopt(sockfd_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                           sizeof(prog));
+    if (ret < 0) {
+        SHLOG_ERROR("setsockopt SO_ATTACH_REUSEPORT_CBPF failed for fd {}: {}", sockfd_,
+                    errno);
+    }
+    return ret;
+}
+
 int TcpSocket::bind(uint16_t port) {
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
@@ -93,6 +149,10 @@ int TcpSocket::bind(uint16_t port) {
     return ::bind(sockfd_, (sockaddr*)&addr, sizeof(addr));
 }
 
+int TcpSocket::bind(const UnixAddress& addr) {
+    return ::bind(sockfd_, addr.sockAddr(), addr.length());
+}
+
 int TcpSocket::listen() { return ::listen(sockfd_, LISTEN_BACKLOG); }
 
 ssize_t TcpSocket::read(void* buf, size_t len) { return ::read(sockfd_, buf, len); }
@@ -109,6 +169,25 @@ ssize_t TcpSocket::send(const void* buf, size_t len, int flags) {
     return ::send(sockfd_, buf, len, flags);
 }
 
+ssize_t TcpSocket::writev(const struct iovec* iov, int iovcnt) {
+    return ::writev(sockfd_, iov, iovcnt);
+}
+
+ssize_t TcpSocket::sendv(const struct iovec* iov, int iovcnt, int flags) {
+    msghdr msg{};
+    msg.msg_iov = const_cast<iovec*>(iov);
+    msg.msg_iovlen = static_cast<size_t>(iovcnt);
+    return ::sendmsg(sockfd_, &msg, flags);
+}
+
+ssize_t TcpSocket::sendFile(int in_fd, off_t offset, size_t count) {
+    return ::sendfile(sockfd_, in_fd, &offset, count);
+}
+
+ssize_t TcpSocket::recvErrorQueue(struct msghdr* msg) {
+    return ::recvmsg(sockfd_, msg, MSG_ERRQUEUE);
+}
+
 void TcpSocket::shutdown() {
     if (sockfd_ != -1) {
         if (::shutdown(sockfd_, SHUT_RDWR) < 0 && errno != ENOTCONN) {
@@ -127,4 +206,9 @@ void TcpSocket::close() {
     }
 }
 
-}  // namespace shnet
\ No newline at end of file
+void TcpSocket::reset(int fd) {
+    close();
+    sockfd_ = fd;
+}
+
+}  // namespace shnet
@@ -0,0 +1,202 @@
+#include "shnet/timer_wheel.h"
+
+#include <algorithm>
+
+namespace shnet {
+
+TimerWheel::TimerWheel(uint64_t now_ms) : current_(now_ms) {
+    for (auto& level : slots_) {
+        level.fill(NIL);
+    }
+}
+
+uint32_t TimerWheel::allocNode() {
+    if (free_list_ != NIL) {
+        uint32_t idx = free_list_;
+        free_list_ = nodes_[idx].next;
+        return idx;
+    }
+    nodes_.push_back(Node{});
+    nodes_.back().gen = 1;
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void TimerWheel::freeNode(uint32_t idx) {
+    Node& node = nodes_[idx];
+    // Invalidate outstanding TimerIds; skip 0, which is never valid.
+    if (++node.gen == 0) {
+        node.gen = 1;
+    }
+    node.cb = nullptr;
+    node.next = free_list_;
+    free_list_ = idx;
+}
+
+TimerWheel::TimerId TimerWheel::add(uint64_t now_ms, uint64_t delay_ms, Callback cb,
+                                    void* obj) {
+    uint32_t idx = allocNode();
+    Node& node = nodes_[idx];
+    const uint64_t base = std::max(now_ms, current_);
+    node.expire = base + std::clamp<uint64_t>(delay_ms, 1, MAX_DELAY - (base - current_));
+    node.cb = cb;
+    node.obj = obj;
+    place(idx);
+    ++size_;
+    return TimerId{idx, node.gen};
+}
+
+bool TimerWheel::cancel(TimerId id) {
+    if (id.gen == 0 || id.index >= nodes_.size()) [[unlikely]] {
+        return false;
+    }
+    Node& node = nodes_[id.index];
+    if (node.gen != id.gen || node.cb == nullptr) {
+        return false;
+    }
+    unlink(id.index);
+    freeNode(id.index);
+    --size_;
+    return true;
+}
+
+void TimerWheel::place(uint32_t idx) {
+    const uint64_t expire = nodes_[idx].expire;
+    const uint64_t diff = expire - current_;
+    int level = 0;
+    while (level < LEVELS - 1 && diff >= (1ull << shiftOf(level + 1))) {
+        ++level;
+    }
+    const uint32_t mask = (level == 0 ? L0_SIZE : LN_SIZE) - 1;
+    link(idx, level, static_cast<uint32_t>(expire >> shiftOf(level)) & mask);
+}
+
+void TimerWheel::link(uint32_t idx, int level, uint32_t slot) {
+    Node& node = nodes_[idx];
+    uint32_t& first = head(level, slot);
+    node.level = static_cast<uint16_t>(level);
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = NIL;
+    node.next = first;
+    if (first != NIL) {
+        nodes_[first].prev = idx;
+    }
+    first = idx;
+    if (level == 0) {
+        l0_bitmap_[slot / 64] |= 1ull << (slot % 64);
+    } else {
+        ++upper_size_;
+    }
+}
+
+void TimerWheel::unlink(uint32_t idx) {
+    Node& node = nodes_[idx];
+    if (node.prev != NIL) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        head(node.level, node.slot) = node.next;
+    }
+    if (node.next != NIL) {
+        nodes_[node.next].prev = node.prev;
+    }
+    if (node.level == 0) {
+        if (head(0, node.slot) == NIL) {
+            l0_bitmap_[node.slot / 64] &= ~(1ull << (node.slot % 64));
+        }
+    } else {
+        --upper_size_;
+    }
+}
+
+void TimerWheel::cascade(int level, uint32_t slot) {
+    uint32_t idx = head(level, slot);
+    head(level, slot) = NIL;
+    while (idx != NIL) {
+        uint32_t next = nodes_[idx].next;
+        --upper_size_;
+        place(idx);
+        idx = next;
+    }
+}
+
+void TimerWheel::expire(uint32_t slot) {
+    // Detach one timer at a time: callbacks may add or cancel timers.
+    uint32_t idx;
+    while ((idx = head(0, slot)) != NIL) {
+        unlink(idx);
+        Node& node = nodes_[idx];
+        Callback cb = node.cb;
+        void* obj = node.obj;
+        freeNode(idx);
+        --size_;
+        cb(obj);
+    }
+}
+
+void TimerWheel::advance(uint64_t now_ms) {
+    if (size_ == 0) {
+        current_ = std::max(current_, now_ms);
+        return;
+    }
+
+    while (current_ < now_ms) {
+        ++current_;
+        if ((current_ & (L0_SIZE - 1)) == 0) {
+            // Pull timers down from the coarser levels whose slot starts now,
+            // coarsest first so they settle in the right finer slot.
+            int top = 1;
+            while (top < LEVELS - 1 &&
+                   ((current_ >> shiftOf(top)) & (LN_SIZE - 1)) == 0) {
+                ++top;
+            }
+            for (int level = top; level >= 1; --level) {
+                cascade(level,
+                        static_cast<uint32_t>(current_ >> shiftOf(level)) & (LN_SIZE - 1));
+            }
+        }
+        expire(static_cast<uint32_t>(current_) & (L0_SIZE - 1));
+        if (size_ == 0) {
+            current_ = now_ms;
+            return;
+        }
+    }
+}
+
+int TimerWheel::findSlot(uint32_t from, uint32_t to) const {
+    for (uint32_t w = from / 64; w * 64 < to; ++w) {
+        uint64_t bits = l0_bitmap_[w];
+        if (w == from / 64) {
+            bits &= ~0ull << (from % 64);
+        }
+        if ((w + 1) * 64 > to) {
+            bits &= (1ull << (to % 64)) - 1;
+        }
+        if (bits != 0) {
+            return static_cast<int>(w * 64 + __builtin_ctzll(bits));
+        }
+    }
+    return -1;
+}
+
+int64_t TimerWheel::nextTimeout(uint64_t now_ms) const {
+    if (size_ == 0) {
+        return -1;
+    }
+
+    // Next non-empty level-0 slot after the current one, wrapping around.
+    const uint32_t cur = static_cast<uint32_t>(current_) & (L0_SIZE - 1);
+    uint64_t next = UINT64_MAX;
+    int slot = findSlot(cur + 1, L0_SIZE);
+    if (slot >= 0) {
+        next = current_ + (static_cast<uint32_t>(slot) - cur);
+    } else if ((slot = findSlot(0, cur)) >= 0) {
+        next = current_ + (static_cast<uint32_t>(slot) + L0_SIZE - cur);
+    }
+    // Coarser timers may be due before that level-0 slot comes around: wake
+    // up when the next of them has to be cascaded as well.
+    if (upper_size_ > 0) {
+        next = std::min(next, (current_ | (L0_SIZE - 1)) + 1);
+    }
+    return next > now_ms ? static_cast<int64_t>(next - now_ms) : 0;
+}
+
+}  // namespace shnet
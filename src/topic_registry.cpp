@@ -0,0 +1,228 @@
+#include "shnet/topic_registry.h"
+
+#include <algorithm>
+#include <cerrno>
+
+namespace shnet {
+
+namespace {
+
+// Level starting at pos, and the position of the next one (npos after the
+// last level).
+std::string_view nextLevel(std::string_view s, size_t pos, size_t& next) {
+    const size_t slash = s.find('/', pos);
+    next = slash == std::string_view::npos ? std::string_view::npos : slash + 1;
+    return s.substr(pos, slash == std::string_view::npos ? std::string_view::npos : slash - pos);
+}
+
+template <typename Subscriptions>
+auto findFilter(Subscriptions& held, std::string_view filter) {
+    return std::find_if(held.begin(), held.end(),
+                        [filter](const auto& sub) { return sub.filter == filter; });
+}
+
+}  // namespace
+
+TopicRegistry::TopicRegistry() : nodes_(1) {}
+
+bool TopicRegistry::isPattern(std::string_view filter) {
+    return filter.find_first_of("+#") != std::string_view::npos;
+}
+
+bool TopicRegistry::isValid(std::string_view filter) {
+    size_t pos = 0;
+    while (true) {
+        size_t next;
+        std::string_view level = nextLevel(filter, pos, next);
+        if (level.size() > 1 && level.find_first_of("+#") != std::string_view::npos) {
+            return false;
+        }
+        if (level == "#" && next != std::string_view::npos) {
+            return false;
+        }
+        if (next == std::string_view::npos) {
+            return true;
+        }
+        pos = next;
+    }
+}
+
+int TopicRegistry::subscribe(int fd, std::string_view filter) {
+    if (!isValid(filter)) [[unlikely]] {
+        return -EINVAL;
+    }
+
+    auto& held = filters_[fd];
+    if (findFilter(held, filter) != held.end()) {
+        return 0;
+    }
+
+    const bool pattern = isPattern(filter);
+    std::vector<int>* fds;
+    if (pattern) {
+        fds = &nodes_[patternNode(filter, true)].fds;
+        ++pattern_subs_;
+    } else {
+        auto it = exact_.find(filter);
+        if (it == exact_.end()) {
+            it = exact_.emplace(std::string(filter), std::vector<int>()).first;
+        }
+        fds = &it->second;
+    }
+    held.push_back({std::string(filter), static_cast<uint32_t>(fds->size())});
+    fds->push_back(fd);
+    return 0;
+}
+
+bool TopicRegistry::unsubscribe(int fd, std::string_view filter) {
+    auto it = filters_.find(fd);
+    if (it == filters_.end()) {
+        return false;
+    }
+    auto& held = it->second;
+    auto sub = findFilter(held, filter);
+    if (sub == held.end()) {
+        return false;
+    }
+    removeFd(fd, *sub);
+    *sub = std::move(held.back());
+    held.pop_back();
+    if (held.empty()) {
+        filters_.erase(it);
+    }
+    return true;
+}
+
+void TopicRegistry::unsubscribeAll(int fd) {
+    auto it = filters_.find(fd);
+    if (it == filters_.end()) {
+        return;
+    }
+    for (const Subscription& sub : it->second) {
+        removeFd(fd, sub);
+    }
+    filters_.erase(it);
+}
+
+void TopicRegistry::removeFd(int fd, const Subscription& sub) {
+    const bool pattern = isPattern(sub.filter);
+    auto exact = exact_.end();
+    std::vector<int>* fds;
+    if (pattern) {
+        // Trie nodes stay for reuse; pattern sets are small and stable
+        // compared to the topics published on.
+        fds = &nodes_[patternNode(sub.filter, false)].fds;
+        --pattern_subs_;
+    } else {
+        exact = exact_.find(sub.filter);
+        fds = &exact->second;
+    }
+
+    const int moved = fds->back();
+    (*fds)[sub.slot] = moved;
+    fds->pop_back();
+    if (moved != fd) {
+        auto& held = filters_.find(moved)->second;
+        findFilter(held, sub.filter)->slot = sub.slot;
+    }
+    if (!pattern && fds->empty()) {
+        exact_.erase(exact);
+    }
+}
+
+uint32_t TopicRegistry::patternNode(std::string_view filter, bool create) {
+    uint32_t idx = 0;
+    size_t pos = 0;
+    while (true) {
+        size_t next_pos;
+        std::string_view level = nextLevel(filter, pos, next_pos);
+        uint32_t next;
+        if (level == "+") {
+            next = nodes_[idx].plus;
+        } else if (level == "#") {
+            next = nodes_[idx].hash;
+        } else {
+            auto it = nodes_[idx].children.find(level);
+            next = it == nodes_[idx].children.end() ? NIL : it->second;
+        }
+
+        if (next == NIL) {
+            if (!create) {
+                return NIL;
+            }
+            next = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+            if (level == "+") {
+                nodes_[idx].plus = next;
+            } else if (level == "#") {
+                nodes_[idx].hash = next;
+            } else {
+                nodes_[idx].children.emplace(std::string(level), next);
+            }
+        }
+
+        idx = next;
+        if (next_pos == std::string_view::npos) {
+            return idx;
+        }
+        pos = next_pos;
+    }
+}
+
+void TopicRegistry::match(std::string_view topic, std::vector<int>& out) {
+    auto it = exact_.find(topic);
+    if (pattern_subs_ == 0) [[likely]] {
+        // A plain filter holds each fd once, so there is nothing to dedupe.
+        if (it != exact_.end()) {
+            out.insert(out.end(), it->second.begin(), it->second.end());
+        }
+        return;
+    }
+
+    if (++epoch_ == 0) [[unlikely]] {
+        std::fill(seen_.begin(), seen_.end(), 0);
+        epoch_ = 1;
+    }
+    if (it != exact_.end()) {
+        collect(it->second, out);
+    }
+    matchNode(0, topic, 0, out);
+}
+
+void TopicRegistry::matchNode(uint32_t idx, std::string_view topic, size_t pos,
+                              std::vector<int>& out) {
+    const Node& node = nodes_[idx];
+    const bool wildcards = idx != 0 || topic.empty() || topic[0] != '$';
+    if (node.hash != NIL && wildcards) {
+        collect(nodes_[node.hash].fds, out);
+    }
+    if (pos == std::string_view::npos) {
+        collect(node.fds, out);
+        return;
+    }
+
+    size_t next;
+    std::string_view level = nextLevel(topic, pos, next);
+    if (node.plus != NIL && wildcards) {
+        matchNode(node.plus, topic, next, out);
+    }
+    auto it = node.children.find(level);
+    if (it != node.children.end()) {
+        matchNode(it->second, topic, next, out);
+    }
+}
+
+void TopicRegistry::collect(const std::vector<int>& fds, std::vector<int>& out) {
+    for (int fd : fds) {
+        if (static_cast<size_t>(fd) >= seen_.size()) {
+            seen_.resize(static_cast<size_t>(fd) + 1, 0);
+        }
+        if (seen_[fd] == epoch_) {
+            continue;
+        }
+        seen_[fd] = epoch_;
+        out.push_back(fd);
+    }
+}
+
+}  // namespace shnet
@@ -0,0 +1,298 @@
+#include "shnet/udp_endpoint.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "shlog/logger.h"
+
+namespace shnet {
+
+namespace {
+
+constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+
+// Segment size the kernel reported for a GRO-coalesced receive, 0 if none.
+size_t groSegmentSize(const msghdr& hdr) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&hdr), cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segment = 0;
+            std::memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            return segment > 0 ? static_cast<size_t>(segment) : 0;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+inline void UdpEndpoint::ioTrampoline(void* obj, uint32_t events) {
+    (void)events;
+    static_cast<UdpEndpoint*>(obj)->handleRead();
+}
+
+UdpEndpoint::UdpEndpoint(EventLoop* loop, size_t max_datagram)
+    : ev_loop_(loop),
+      sk_([] {
+          int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+          if (fd == -1) [[unlikely]] {
+              throw std::system_error(errno, std::system_category(),
+                                      "fail to create udp endpoint fd");
+          }
+          return fd;
+      }()),
+      max_datagram_(max_datagram),
+      slot_size_(max_datagram),
+      control_(BATCH_SIZE * CONTROL_SIZE),
+      iovs_(BATCH_SIZE),
+      msgs_(BATCH_SIZE),
+      peers_(BATCH_SIZE) {
+    batch_.reserve(BATCH_SIZE);
+    allocArena();
+}
+
+UdpEndpoint::~UdpEndpoint() {
+    if (registered_) {
+        ev_loop_->delEvent(sk_.fd());
+    }
+    sk_.close();
+}
+
+void UdpEndpoint::allocArena() {
+    arena_ = std::make_unique_for_overwrite<char[]>(BATCH_SIZE * slot_size_);
+    for (unsigned int i = 0; i < BATCH_SIZE; ++i) {
+        iovs_[i] = {arena_.get() + i * slot_size_, slot_size_};
+        msghdr& hdr = msgs_[i].msg_hdr;
+        hdr = {};
+        hdr.msg_name = &peers_[i];
+        hdr.msg_iov = &iovs_[i];
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control_.data() + i * CONTROL_SIZE;
+    }
+}
+
+int UdpEndpoint::enableGro() {
+    if (gro_) {
+        return 0;
+    }
+    if (sk_.setGro(true) < 0) {
+        return -errno;
+    }
+    gro_ = true;
+    slot_size_ = std::max(max_datagram_, GRO_SLOT_SIZE);
+    allocArena();
+    return 0;
+}
+
+int UdpEndpoint::bind(const std::string& ip, uint16_t port) {
+    if (registered_) [[unlikely]] {
+        return -EINVAL;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) <= 0) {
+        SHLOG_ERROR("inet_pton failed for ip {}: {}", ip, errno);
+        return -EINVAL;
+    }
+
+    const int fd = sk_.fd();
+    if (sk_.bind(addr) < 0) {
+        SHLOG_ERROR("bind failed for udp fd {}: {}", fd, errno);
+        return -errno;
+    }
+
+    io_handler_ = EventLoop::EventHandler{this, &ioTrampoline};
+    if (ev_loop_->addEvent(fd, EPOLLIN, &io_handler_) < 0) [[unlikely]] {
+        SHLOG_ERROR("failed to register udp fd {} to epoll: {}", fd, errno);
+        return -errno;
+    }
+    registered_ = true;
+    return 0;
+}
+
+void UdpEndpoint::handleRead() {
+    for (int round = 0; round < MAX_BATCHES_PER_EVENT; ++round) {
+        // recvmmsg() overwrites the lengths, restore them for this round.
+        for (unsigned int i = 0; i < BATCH_SIZE; ++i) {
+            msghdr& hdr = msgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_controllen = gro_ ? CONTROL_SIZE : 0;
+        }
+
+        const int n = sk_.recvBatch(msgs_.data(), BATCH_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) [[unlikely]] {
+                SHLOG_ERROR("recvmmsg failed for udp fd {}: {}", sk_.fd(), errno);
+            }
+            return;
+        }
+
+        batch_.clear();
+        for (int i = 0; i < n; ++i) {
+            const msghdr& hdr = msgs_[i].msg_hdr;
+            if (hdr.msg_flags & MSG_TRUNC) [[unlikely]] {
+                ++truncated_;
+                continue;
+            }
+            const char* data = static_cast<const char*>(iovs_[i].iov_base);
+            const size_t len = msgs_[i].msg_len;
+            const size_t segment = gro_ ? groSegmentSize(hdr) : 0;
+            if (segment == 0 || segment >= len) {
+                batch_.push_back({data, len, peers_[i]});
+                continue;
+            }
+            for (size_t off = 0; off < len; off += segment) {
+                batch_.push_back({data + off, std::min(segment, len - off), peers_[i]});
+            }
+        }
+        if (!batch_.empty() && recv_cb_) {
+            recv_cb_(this, batch_);
+        }
+
+        if (static_cast<unsigned int>(n) < BATCH_SIZE) {
+            return;
+        }
+    }
+    // Still readable; level-triggered polling reports it again next round.
+}
+
+int UdpEndpoint::sendTo(const sockaddr_in& peer, const char* data, size_t size) {
+    Datagram datagram{data, size, peer};
+    return send(std::span<const Datagram>(&datagram, 1));
+}
+
+int UdpEndpoint::send(std::span<const Datagram> datagrams) {
+    mmsghdr msgs[BATCH_SIZE];
+    iovec iovs[BATCH_SIZE];
+
+    size_t sent = 0;
+    while (sent < datagrams.size()) {
+        const auto n =
+            static_cast<unsigned int>(std::min<size_t>(BATCH_SIZE, datagrams.size() - sent));
+        for (unsigned int i = 0; i < n; ++i) {
+            const Datagram& d = datagrams[sent + i];
+            iovs[i] = {const_cast<char*>(d.data), d.size};
+            msghdr& hdr = msgs[i].msg_hdr;
+            hdr = {};
+            hdr.msg_name = const_cast<sockaddr_in*>(&d.peer);
+            hdr.msg_namelen = sizeof(sockaddr_in);
+            hdr.msg_iov = &iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+
+        const int ret = sk_.sendBatch(msgs, n);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (sent > 0) {
+                break;
+            }
+            return -errno;
+        }
+        sent += static_cast<size_t>(ret);
+        if (static_cast<unsigned int>(ret) < n) {
+            break;
+        }
+    }
+    return static_cast<int>(sent);
+}
+
+int UdpEndpoint::sendSegmented(const sockaddr_in& peer, const char* data, size_t size,
+                               size_t segment) {
+    if (segment == 0 || segment > MAX_GSO_BYTES) [[unlikely]] {
+        return -EINVAL;
+    }
+    if (size <= segment || !gso_) {
+        return sendSlices(peer, data, size, segment);
+    }
+
+    const size_t max_chunk = segment * std::min(MAX_GSO_SEGMENTS, MAX_GSO_BYTES / segment);
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+    iovec iov;
+    msghdr hdr{};
+    hdr.msg_name = const_cast<sockaddr_in*>(&peer);
+    hdr.msg_namelen = sizeof(sockaddr_in);
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+
+    size_t sent = 0;
+    size_t offset = 0;
+    while (offset < size) {
+        const size_t chunk = std::min(max_chunk, size - offset);
+        iov = {const_cast<char*>(data + offset), chunk};
+        if (chunk > segment) {
+            hdr.msg_control = control;
+            hdr.msg_controllen = sizeof(control);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            const auto gso_size = static_cast<uint16_t>(segment);
+            std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        } else {
+            hdr.msg_control = nullptr;
+            hdr.msg_controllen = 0;
+        }
+
+        if (sk_.sendMsg(&hdr) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (chunk > segment && (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT))
+                [[unlikely]] {
+                // No GSO on this kernel or route; stay on plain sendmmsg().
+                SHLOG_WARN("UDP GSO unavailable on fd {}: {}", sk_.fd(), errno);
+                gso_ = false;
+                int ret = sendSlices(peer, data + offset, size - offset, segment);
+                if (ret < 0) {
+                    return sent > 0 ? static_cast<int>(sent) : ret;
+                }
+                return static_cast<int>(sent) + ret;
+            }
+            return sent > 0 ? static_cast<int>(sent) : -errno;
+        }
+        sent += (chunk + segment - 1) / segment;
+        offset += chunk;
+    }
+    return static_cast<int>(sent);
+}
+
+int UdpEndpoint::sendSlices(const sockaddr_in& peer, const char* data, size_t size,
+                            size_t segment) {
+    Datagram slices[BATCH_SIZE];
+
+    size_t sent = 0;
+    size_t offset = 0;
+    while (offset < size) {
+        unsigned int n = 0;
+        size_t end = offset;
+        while (n < BATCH_SIZE && end < size) {
+            const size_t len = std::min(segment, size - end);
+            slices[n++] = {data + end, len, peer};
+            end += len;
+        }
+
+        const int ret = send(std::span<const Datagram>(slices, n));
+        if (ret < 0) {
+            return sent > 0 ? static_cast<int>(sent) : ret;
+        }
+        sent += static_cast<size_t>(ret);
+        if (static_cast<unsigned int>(ret) < n) {
+            break;
+        }
+        offset = end;
+    }
+    return static_cast<int>(sent);
+}
+
+}  // namespace shnet
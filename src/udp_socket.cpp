@@ -0,0 +1,70 @@
+#include "shnet/udp_socket.h"
+
+#include <cerrno>
+
+#include "shlog/logger.h"
+
+namespace shnet {
+
+UdpSocket::UdpSocket(int fd) : sockfd_(fd) {}
+
+UdpSocket::~UdpSocket() { close(); }
+
+void UdpSocket::setReusable() {
+    int reuse_addr = 1;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(reuse_addr)) < 0) {
+        SHLOG_ERROR("setsockopt SO_REUSEADDR failed for fd {}: {}", sockfd_, errno);
+    }
+    int reuse_port = 1;
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_REUSEPORT, &reuse_port, sizeof(reuse_port)) < 0) {
+        SHLOG_ERROR("setsockopt SO_REUSEPORT failed for fd {}: {}", sockfd_, errno);
+    }
+}
+
+void UdpSocket::setRcvBufSize(int rcvBufSize) {
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize)) < 0) {
+        SHLOG_ERROR("setsockopt SO_RCVBUF failed for fd {}: {}", sockfd_, errno);
+    }
+}
+
+void UdpSocket::setSndBufSize(int sndBufSize) {
+    if (::setsockopt(sockfd_, SOL_SOCKET, SO_SNDBUF, &sndBufSize, sizeof(sndBufSize)) < 0) {
+        SHLOG_ERROR("setsockopt SO_SNDBUF failed for fd {}: {}", sockfd_, errno);
+    }
+}
+
+int UdpSocket::setGro(bool enable) {
+    int on = enable ? 1 : 0;
+    int ret = ::setsockopt(sockfd_, SOL_UDP, UDP_GRO, &on, sizeof(on));
+    if (ret < 0) {
+        SHLOG_ERROR("setsockopt UDP_GRO failed for fd {}: {}", sockfd_, errno);
+    }
+    return ret;
+}
+
+int UdpSocket::bind(const sockaddr_in& addr) {
+    return ::bind(sockfd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+void UdpSocket::close() {
+    if (sockfd_ != -1) {
+        if (::close(sockfd_) < 0) {
+            SHLOG_ERROR("close failed for fd {}: {}", sockfd_, errno);
+        }
+        sockfd_ = -1;
+    }
+}
+
+int UdpSocket::recvBatch(struct mmsghdr* msgs, unsigned int n) {
+    return ::recvmmsg(sockfd_, msgs, n, MSG_DONTWAIT, nullptr);
+}
+
+int UdpSocket::sendBatch(struct mmsghdr* msgs, unsigned int n) {
+    return ::sendmmsg(sockfd_, msgs, n, MSG_DONTWAIT);
+}
+
+ssize_t UdpSocket::sendMsg(const struct msghdr* msg) {
+    return ::sendmsg(sockfd_, msg, MSG_DONTWAIT);
+}
+
+}  // namespace shnet
@@ -0,0 +1,121 @@
+#include "shnet/timer_wheel.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using shnet::TimerWheel;
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                       \
+    do {                                                                  \
+        if (!(cond)) {                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, \
+                         __LINE__, #cond);                                \
+            ++failures;                                                   \
+        }                                                                 \
+    } while (0)
+
+uint64_t now = 0;
+
+struct Probe {
+    uint64_t due;
+    uint64_t fired_at = 0;
+    int fired = 0;
+};
+
+void onFire(void* obj) {
+    auto* probe = static_cast<Probe*>(obj);
+    probe->fired_at = now;
+    ++probe->fired;
+}
+
+// Drives the wheel the way EventLoop does: sleep for nextTimeout(), then
+// advance() to the new time, until no timer is left.
+void runToEmpty(TimerWheel& wheel) {
+    int64_t timeout;
+    while ((timeout = wheel.nextTimeout(now)) >= 0) {
+        now += static_cast<uint64_t>(timeout > 0 ? timeout : 1);
+        wheel.advance(now);
+    }
+}
+
+// A coarser timer must not be skipped over because a later level-0 slot is
+// occupied: nextTimeout() has to stop at the cascade boundary first.
+void testCascadeBoundaryWithBusyLevel0() {
+    now = 0;
+    TimerWheel wheel(now);
+    Probe coarse{300};
+    wheel.add(now, 300, &onFire, &coarse);
+
+    now = 250;
+    wheel.advance(now);
+    Probe fine{400};
+    wheel.add(now, 150, &onFire, &fine);
+
+    CHECK(wheel.nextTimeout(now) == 6);
+    runToEmpty(wheel);
+    CHECK(coarse.fired == 1 && coarse.fired_at == 300);
+    CHECK(fine.fired == 1 && fine.fired_at == 400);
+}
+
+void testOnlyCoarseTimers() {
+    now = 1000;
+    TimerWheel wheel(now);
+    Probe probe{1000 + 70000};
+    wheel.add(now, 70000, &onFire, &probe);
+    CHECK(wheel.nextTimeout(now) == 24);
+    runToEmpty(wheel);
+    CHECK(probe.fired == 1 && probe.fired_at == probe.due);
+}
+
+// Random deadlines across all levels, some cancelled: every live timer fires
+// exactly once, exactly on time.
+void testRandomDeadlines() {
+    std::mt19937_64 rng(42);
+    now = rng() % 100000;
+    TimerWheel wheel(now);
+
+    std::vector<Probe> probes(5000);
+    std::vector<TimerWheel::TimerId> ids(probes.size());
+    for (size_t i = 0; i < probes.size(); ++i) {
+        const int bits = static_cast<int>(rng() % 25);
+        const uint64_t delay = 1 + rng() % (1ull << bits);
+        probes[i].due = now + delay;
+        ids[i] = wheel.add(now, delay, &onFire, &probes[i]);
+    }
+    std::vector<bool> cancelled(probes.size());
+    for (size_t i = 0; i < probes.size(); i += 7) {
+        cancelled[i] = wheel.cancel(ids[i]);
+        CHECK(cancelled[i]);
+    }
+
+    runToEmpty(wheel);
+    CHECK(wheel.size() == 0);
+    for (size_t i = 0; i < probes.size(); ++i) {
+        if (cancelled[i]) {
+            CHECK(probes[i].fired == 0);
+        } else {
+            CHECK(probes[i].fired == 1 && probes[i].fired_at == probes[i].due);
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    testCascadeBoundaryWithBusyLevel0();
+    testOnlyCoarseTimers();
+    testRandomDeadlines();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    std::puts("timer_wheel_test passed");
+    return EXIT_SUCCESS;
+}